@@ -14,9 +14,12 @@ ConnectionPool::ConnectionPool(size_t min_pageserver, size_t max_pageserver,
     , max_safekeeper_connections(max_safekeeper)
     , min_pageserver_connections(min_pageserver)
     , min_safekeeper_connections(min_safekeeper)
+    , page_compression(PAGE_COMPRESSION_NONE)
+    , wal_group_commit_delay_us(0)
+    , wal_group_commit_max_bytes(1 << 20)
+    , wal_max_batches_in_flight(8)
 {
     // Reserve space for connections
-    all_pageserver_connections.reserve(max_pageserver_connections);
     all_safekeeper_connections.reserve(max_safekeeper_connections);
 }
 
@@ -25,6 +28,11 @@ ConnectionPool::~ConnectionPool() {
 }
 
 bool ConnectionPool::initialize() {
+    if (pageserver_shards.empty()) {
+        sql_print_error("ServerlessDB: Connection pool has no pageserver to connect to");
+        return false;
+    }
+    
     try {
         // Create minimum number of connections
         warm_connections();
@@ -33,8 +41,9 @@ bool ConnectionPool::initialize() {
         health_check_running = true;
         health_check_thread = std::thread(&ConnectionPool::health_check_worker, this);
         
-        sql_print_information("ServerlessDB: Connection pool initialized with %zu pageserver and %zu safekeeper connections",
-                              min_pageserver_connections, min_safekeeper_connections);
+        sql_print_information("ServerlessDB: Connection pool initialized with %zu pageserver connections to each of %zu shards and %zu safekeeper connections",
+                              min_pageserver_connections, pageserver_shards.size(),
+                              min_safekeeper_connections);
         
         return true;
     } catch (const std::exception& e) {
@@ -51,12 +60,10 @@ void ConnectionPool::shutdown() {
     }
     
     // Clear all connections
-    {
-        std::lock_guard<std::mutex> lock(pageserver_mutex);
-        while (!available_pageserver_connections.empty()) {
-            available_pageserver_connections.pop();
-        }
-        all_pageserver_connections.clear();
+    for (auto& shard : pageserver_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->available.clear();
+        shard->connections.clear();
     }
     
     {
@@ -70,9 +77,14 @@ void ConnectionPool::shutdown() {
     sql_print_information("ServerlessDB: Connection pool shutdown complete");
 }
 
-std::unique_ptr<PageserverClient> ConnectionPool::create_pageserver_connection() {
+std::unique_ptr<PageserverClient> ConnectionPool::create_pageserver_connection(
+    const PageserverShardMap::Shard& endpoint) {
     try {
-        std::unique_ptr<PageserverClient> client(new PageserverClient("http://localhost:9997"));
+        std::unique_ptr<PageserverClient> client(new PageserverClient(endpoint.url.c_str()));
+        if (endpoint.page_service_port) {
+            client->set_page_service(endpoint.host.c_str(), endpoint.page_service_port);
+        }
+        client->set_compression(page_compression);
         
         // Test connection
         if (!is_connection_healthy(client.get())) {
@@ -90,6 +102,8 @@ std::unique_ptr<PageserverClient> ConnectionPool::create_pageserver_connection()
 std::unique_ptr<SafekeeperClient> ConnectionPool::create_safekeeper_connection() {
     try {
         std::unique_ptr<SafekeeperClient> client(new SafekeeperClient("localhost", 5433));
+        client->set_group_commit(wal_group_commit_delay_us, wal_group_commit_max_bytes);
+        client->set_max_batches_in_flight(wal_max_batches_in_flight);
         
         // Test connection
         if (!is_connection_healthy(client.get())) {
@@ -104,39 +118,64 @@ std::unique_ptr<SafekeeperClient> ConnectionPool::create_safekeeper_connection()
     }
 }
 
-PageserverClient* ConnectionPool::get_pageserver_connection(std::chrono::milliseconds timeout) {
+PageserverClient* ConnectionPool::get_pageserver_connection(size_t shard,
+                                                            std::chrono::milliseconds timeout) {
+    if (shard >= pageserver_shards.size()) {
+        return nullptr;
+    }
+    
     pageserver_requests++;
+    PageserverShardPool& pool = *pageserver_shards[shard];
     
-    std::unique_lock<std::mutex> lock(pageserver_mutex);
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    
+    // Open another connection to the shard rather than wait while
+    // under the limit
+    if (pool.available.empty()) {
+        PageserverClient* client = add_pageserver_connection(pool, lock);
+        if (client) {
+            return client;
+        }
+    }
     
     // Wait for available connection or timeout
-    if (!pageserver_cv.wait_for(lock, timeout, [this] {
-        return !available_pageserver_connections.empty();
+    if (!pool.cv.wait_for(lock, timeout, [&pool] {
+        return !pool.available.empty();
     })) {
-        // Timeout - try to create new connection if under limit
-        if (all_pageserver_connections.size() < max_pageserver_connections) {
-            auto new_connection = create_pageserver_connection();
-            if (new_connection) {
-                PageserverClient* client = new_connection.get();
-                all_pageserver_connections.push_back(std::move(new_connection));
-                return client;
-            }
-        }
-        
-        sql_print_warning("ServerlessDB: Timeout waiting for pageserver connection");
+        sql_print_warning("ServerlessDB: Timeout waiting for connection to pageserver %s",
+                          pool.endpoint.url.c_str());
         return nullptr;
     }
     
     // Get connection from pool
-    auto connection = std::move(available_pageserver_connections.front());
-    available_pageserver_connections.pop();
-    
-    PageserverClient* client = connection.release();
+    PageserverClient* client = pool.available.front();
+    pool.available.pop_front();
     pageserver_cache_hits++;
     
     return client;
 }
 
+PageserverClient* ConnectionPool::add_pageserver_connection(PageserverShardPool& pool,
+                                                            std::unique_lock<std::mutex>& lock) {
+    if (pool.connections.size() + pool.connecting >= max_pageserver_connections) {
+        return nullptr;
+    }
+    
+    // Reserve the slot, connect unlocked
+    pool.connecting++;
+    lock.unlock();
+    auto new_connection = create_pageserver_connection(pool.endpoint);
+    lock.lock();
+    pool.connecting--;
+    
+    if (!new_connection) {
+        return nullptr;
+    }
+    PageserverClient* client = new_connection.get();
+    pool.connections.push_back(std::move(new_connection));
+    return client;
+}
+
 SafekeeperClient* ConnectionPool::get_safekeeper_connection(std::chrono::milliseconds timeout) {
     safekeeper_requests++;
     
@@ -173,24 +212,25 @@ SafekeeperClient* ConnectionPool::get_safekeeper_connection(std::chrono::millise
 void ConnectionPool::return_pageserver_connection(PageserverClient* client) {
     if (!client) return;
     
-    std::lock_guard<std::mutex> lock(pageserver_mutex);
-    
-    // Find the connection in our managed list
-    auto it = std::find_if(all_pageserver_connections.begin(), all_pageserver_connections.end(),
-                          [client](const std::unique_ptr<PageserverClient>& ptr) {
-                              return ptr.get() == client;
-                          });
-    
-    if (it != all_pageserver_connections.end()) {
-        // Return to available pool
-        available_pageserver_connections.push(std::move(*it));
-        all_pageserver_connections.erase(it);
+    // Find the shard owning the connection
+    for (auto& shard : pageserver_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        auto it = std::find_if(shard->connections.begin(), shard->connections.end(),
+                              [client](const std::unique_ptr<PageserverClient>& ptr) {
+                                  return ptr.get() == client;
+                              });
         
-        // Notify waiting threads
-        pageserver_cv.notify_one();
-    } else {
-        sql_print_warning("ServerlessDB: Attempted to return unknown pageserver connection");
+        if (it != shard->connections.end()) {
+            // Return to available pool
+            shard->available.push_back(client);
+            
+            // Notify waiting threads
+            shard->cv.notify_one();
+            return;
+        }
     }
+    
+    sql_print_warning("ServerlessDB: Attempted to return unknown pageserver connection");
 }
 
 void ConnectionPool::return_safekeeper_connection(SafekeeperClient* client) {
@@ -217,40 +257,21 @@ void ConnectionPool::return_safekeeper_connection(SafekeeperClient* client) {
 }
 
 void ConnectionPool::warm_connections() {
-    // Create minimum pageserver connections
-    {
-        std::lock_guard<std::mutex> lock(pageserver_mutex);
-        for (size_t i = 0; i < min_pageserver_connections; ++i) {
-            auto connection = create_pageserver_connection();
-            if (connection) {
-                available_pageserver_connections.push(std::move(connection));
-            } else {
-                sql_print_warning("ServerlessDB: Failed to create pageserver connection %zu during warm-up", i);
+    // Top up every shard to its minimum pageserver connections
+    size_t pageserver_total = 0;
+    for (auto& shard : pageserver_shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        while (shard->connections.size() + shard->connecting < min_pageserver_connections) {
+            PageserverClient* connection = add_pageserver_connection(*shard, lock);
+            if (!connection) {
+                sql_print_warning("ServerlessDB: Failed to create connection %zu to pageserver %s during warm-up",
+                                  shard->connections.size(), shard->endpoint.url.c_str());
+                break;
             }
+            shard->available.push_back(connection);
+            shard->cv.notify_one();
         }
-        
-        // Move to managed list
-        while (!available_pageserver_connections.empty()) {
-            all_pageserver_connections.push_back(std::move(available_pageserver_connections.front()));
-            available_pageserver_connections.pop();
-        }
-        
-        // Add back to available
-        for (auto& conn : all_pageserver_connections) {
-            available_pageserver_connections.push(std::unique_ptr<PageserverClient>(conn.release()));
-        }
-        all_pageserver_connections.clear();
-        
-        // Rebuild managed list
-        while (!available_pageserver_connections.empty()) {
-            all_pageserver_connections.push_back(std::move(available_pageserver_connections.front()));
-            available_pageserver_connections.pop();
-        }
-        
-        // Add back to available for use
-        for (size_t i = 0; i < all_pageserver_connections.size(); ++i) {
-            available_pageserver_connections.push(std::unique_ptr<PageserverClient>(all_pageserver_connections[i].get()));
-        }
+        pageserver_total += shard->connections.size();
     }
     
     // Create minimum safekeeper connections
@@ -272,7 +293,7 @@ void ConnectionPool::warm_connections() {
     }
     
     sql_print_information("ServerlessDB: Warmed %zu pageserver and %zu safekeeper connections",
-                          all_pageserver_connections.size(), all_safekeeper_connections.size());
+                          pageserver_total, all_safekeeper_connections.size());
 }
 
 bool ConnectionPool::is_connection_healthy(PageserverClient* client) {
@@ -305,18 +326,40 @@ void ConnectionPool::health_check_worker() {
         
         if (!health_check_running) break;
         
-        // Check pageserver connections
-        {
-            std::lock_guard<std::mutex> lock(pageserver_mutex);
-            auto it = all_pageserver_connections.begin();
-            while (it != all_pageserver_connections.end()) {
-                if (!is_connection_healthy(it->get())) {
-                    sql_print_information("ServerlessDB: Removing unhealthy pageserver connection");
-                    it = all_pageserver_connections.erase(it);
+        // Check idle pageserver connections; ones in use are checked
+        // once they are returned
+        for (auto& shard : pageserver_shards) {
+            // Probe them unlocked, so an unreachable pageserver does not
+            // hold up the shard's readers
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            std::deque<PageserverClient*> idle;
+            idle.swap(shard->available);
+            lock.unlock();
+            
+            std::vector<PageserverClient*> unhealthy;
+            for (auto it = idle.begin(); it != idle.end(); ) {
+                if (!is_connection_healthy(*it)) {
+                    unhealthy.push_back(*it);
+                    it = idle.erase(it);
                 } else {
                     ++it;
                 }
             }
+            
+            lock.lock();
+            for (PageserverClient* client : idle) {
+                shard->available.push_back(client);
+                shard->cv.notify_one();
+            }
+            for (PageserverClient* client : unhealthy) {
+                sql_print_information("ServerlessDB: Removing unhealthy connection to pageserver %s",
+                                      shard->endpoint.url.c_str());
+                shard->connections.erase(std::find_if(
+                    shard->connections.begin(), shard->connections.end(),
+                    [client](const std::unique_ptr<PageserverClient>& ptr) {
+                        return ptr.get() == client;
+                    }));
+            }
         }
         
         // Check safekeeper connections
@@ -348,13 +391,16 @@ void ConnectionPool::scale_pool_if_needed() {
         static_cast<double>(safekeeper_cache_hits) / safekeeper_requests : 1.0;
     
     // If hit rate is low, consider adding more connections
-    if (pageserver_hit_rate < 0.8 && all_pageserver_connections.size() < max_pageserver_connections) {
-        std::lock_guard<std::mutex> lock(pageserver_mutex);
-        auto new_connection = create_pageserver_connection();
-        if (new_connection) {
-            all_pageserver_connections.push_back(std::move(new_connection));
-            sql_print_information("ServerlessDB: Scaled up pageserver connections to %zu", 
-                                 all_pageserver_connections.size());
+    if (pageserver_hit_rate < 0.8) {
+        for (auto& shard : pageserver_shards) {
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            PageserverClient* new_connection = add_pageserver_connection(*shard, lock);
+            if (new_connection) {
+                shard->available.push_back(new_connection);
+                shard->cv.notify_one();
+                sql_print_information("ServerlessDB: Scaled up connections to pageserver %s to %zu",
+                                      shard->endpoint.url.c_str(), shard->connections.size());
+            }
         }
     }
     
@@ -372,10 +418,13 @@ void ConnectionPool::scale_pool_if_needed() {
 ConnectionPool::PoolStats ConnectionPool::get_stats() const {
     PoolStats stats;
     
-    {
-        std::lock_guard<std::mutex> lock(pageserver_mutex);
-        stats.pageserver_total = all_pageserver_connections.size();
-        stats.pageserver_available = available_pageserver_connections.size();
+    stats.pageserver_shards = pageserver_shards.size();
+    stats.pageserver_total = 0;
+    stats.pageserver_available = 0;
+    for (const auto& shard : pageserver_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.pageserver_total += shard->connections.size();
+        stats.pageserver_available += shard->available.size();
     }
     
     {
@@ -413,3 +462,26 @@ void ConnectionPool::set_pool_limits(size_t min_pageserver, size_t max_pageserve
     min_safekeeper_connections = min_safekeeper;
     max_safekeeper_connections = max_safekeeper;
 }
+
+void ConnectionPool::set_pageserver_shards(const PageserverShardMap& shards) {
+    pageserver_shards.clear();
+    for (size_t i = 0; i < shards.shard_count(); ++i) {
+        std::unique_ptr<PageserverShardPool> pool(new PageserverShardPool);
+        pool->endpoint = shards.shard(i);
+        pool->connections.reserve(max_pageserver_connections);
+        pageserver_shards.push_back(std::move(pool));
+    }
+}
+
+void ConnectionPool::set_page_compression(PageCompression codec) {
+    page_compression = codec;
+}
+
+void ConnectionPool::set_wal_group_commit(uint32_t delay_us, size_t max_bytes) {
+    wal_group_commit_delay_us = delay_us;
+    wal_group_commit_max_bytes = max_bytes;
+}
+
+void ConnectionPool::set_wal_pipelining(size_t max_batches_in_flight) {
+    wal_max_batches_in_flight = max_batches_in_flight;
+}
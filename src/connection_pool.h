@@ -2,35 +2,53 @@
 #define CONNECTION_POOL_H
 
 #include <vector>
+#include <deque>
 #include <queue>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <chrono>
+#include <string>
 #include <thread>
 
 #include "pageserver_client.h"
+#include "pageserver_shard_map.h"
 #include "safekeeper_client.h"
 
 /**
  * High-performance connection pool for serverless MariaDB storage engine
  * Eliminates cold start overhead by pre-warming connections
+ *
+ * Pageserver connections are kept in one sub-pool per shard of the
+ * pageserver shard map, each with its own lock and connection limits,
+ * so readers of different shards never contend.
  */
 class ConnectionPool {
 private:
-    // Pageserver connection pool
-    std::queue<std::unique_ptr<PageserverClient>> available_pageserver_connections;
-    std::vector<std::unique_ptr<PageserverClient>> all_pageserver_connections;
+    // Pageserver connections to one shard. Every connection is owned
+    // by connections; the idle ones are also listed in available.
+    // Connections being opened hold a slot in connecting, as they are
+    // opened without the mutex.
+    struct PageserverShardPool {
+        PageserverShardMap::Shard endpoint;
+        std::vector<std::unique_ptr<PageserverClient>> connections;
+        std::deque<PageserverClient*> available;
+        size_t connecting;
+        std::mutex mutex;
+        std::condition_variable cv;
+        
+        PageserverShardPool() : connecting(0) {}
+    };
+    
+    std::vector<std::unique_ptr<PageserverShardPool>> pageserver_shards;
     
     // Safekeeper connection pool
     std::queue<std::unique_ptr<SafekeeperClient>> available_safekeeper_connections;
     std::vector<std::unique_ptr<SafekeeperClient>> all_safekeeper_connections;
     
     // Thread safety
-    mutable std::mutex pageserver_mutex;
     mutable std::mutex safekeeper_mutex;
-    std::condition_variable pageserver_cv;
     std::condition_variable safekeeper_cv;
     
     // Pool configuration
@@ -39,6 +57,14 @@ private:
     size_t min_pageserver_connections;
     size_t min_safekeeper_connections;
     
+    // Codec new pageserver connections ask page images in
+    PageCompression page_compression;
+    
+    // Group commit settings of new safekeeper connections
+    uint32_t wal_group_commit_delay_us;
+    size_t wal_group_commit_max_bytes;
+    size_t wal_max_batches_in_flight;
+    
     // Connection health monitoring
     std::atomic<bool> health_check_running{false};
     std::thread health_check_thread;
@@ -51,7 +77,13 @@ private:
     std::atomic<uint64_t> safekeeper_cache_hits{0};
     
     // Connection creation
-    std::unique_ptr<PageserverClient> create_pageserver_connection();
+    std::unique_ptr<PageserverClient> create_pageserver_connection(const PageserverShardMap::Shard& endpoint);
+    // Open one more connection to the shard if under the limit. Called
+    // and returns with pool.mutex held through lock, but connects with
+    // it released, so a slow pageserver only delays the caller. The
+    // new connection is owned by the pool and not yet available.
+    PageserverClient* add_pageserver_connection(PageserverShardPool& pool,
+                                                std::unique_lock<std::mutex>& lock);
     std::unique_ptr<SafekeeperClient> create_safekeeper_connection();
     
     // Health monitoring
@@ -60,6 +92,7 @@ private:
     bool is_connection_healthy(SafekeeperClient* client);
     
 public:
+    // Pageserver limits apply to each shard
     ConnectionPool(size_t min_pageserver = 5, size_t max_pageserver = 20,
                    size_t min_safekeeper = 3, size_t max_safekeeper = 10);
     ~ConnectionPool();
@@ -68,8 +101,10 @@ public:
     bool initialize();
     void shutdown();
     
-    // Connection management
-    PageserverClient* get_pageserver_connection(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+    // Connection management; shard indexes the shard map passed to
+    // set_pageserver_shards()
+    PageserverClient* get_pageserver_connection(size_t shard = 0,
+                                                std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
     SafekeeperClient* get_safekeeper_connection(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
     
     void return_pageserver_connection(PageserverClient* client);
@@ -81,6 +116,7 @@ public:
     
     // Statistics and monitoring
     struct PoolStats {
+        size_t pageserver_shards;
         size_t pageserver_total;
         size_t pageserver_available;
         size_t safekeeper_total;
@@ -98,6 +134,23 @@ public:
     void set_health_check_interval(std::chrono::seconds interval);
     void set_pool_limits(size_t min_pageserver, size_t max_pageserver,
                         size_t min_safekeeper, size_t max_safekeeper);
+    
+    // Create one sub-pool per shard, connecting to the shard's URL and,
+    // if it has one, its binary page service; call before initialize()
+    void set_pageserver_shards(const PageserverShardMap& shards);
+    size_t pageserver_shard_count() const { return pageserver_shards.size(); }
+    
+    // Make new pageserver connections request compressed page images;
+    // call before initialize()
+    void set_page_compression(PageCompression codec);
+    
+    // Group commit settings of new safekeeper connections; call
+    // before initialize()
+    void set_wal_group_commit(uint32_t delay_us, size_t max_bytes);
+    
+    // Unacknowledged WAL batches new safekeeper connections stream;
+    // call before initialize()
+    void set_wal_pipelining(size_t max_batches_in_flight);
 };
 
 // Simple RAII connection wrappers for automatic return to pool
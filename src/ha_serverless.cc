@@ -16,8 +16,15 @@
 
 #include "ha_serverless.h"
 #include "pageserver_client.h"
+#include "pageserver_shard_map.h"
 #include "safekeeper_client.h"
 #include "connection_pool.h"
+#include "page_cache.h"
+#include "local_file_cache.h"
+#include "page_cache_warmer.h"
+#include "page_fetch_engine.h"
+#include "page_compression.h"
+#include "timeline_info_cache.h"
 
 #include <my_global.h>
 #include <mysql/plugin.h>
@@ -25,10 +32,10 @@
 #include <handler.h>
 #include <table.h>
 #include <field.h>
+#include <algorithm>
 #include <chrono>
-
-// MariaDB page size (16KB)
-static const uint32_t MARIADB_PAGE_SIZE = 16384;
+#include <new>
+#include <vector>
 
 // Forward declarations
 static uint64_t hash_string(const char* str);
@@ -43,8 +50,34 @@ struct PerformanceStats {
     std::atomic<uint64_t> cache_hits{0};
     std::atomic<uint64_t> network_calls{0};
     std::atomic<uint64_t> total_latency_ms{0};
+    std::atomic<uint64_t> read_ahead_pages{0};
 } perf_stats;
 
+// System variables
+static ulonglong serverless_page_cache_size;
+static uint serverless_page_cache_shards;
+static ulong serverless_page_cache_policy;
+static my_bool serverless_page_cache_large_pages;
+static char* serverless_local_cache_path;
+static ulonglong serverless_local_cache_size;
+static ulong serverless_local_cache_admission;
+static char* serverless_page_cache_dump_file;
+static uint serverless_page_cache_dump_interval;
+static my_bool serverless_page_cache_load_at_startup;
+static uint serverless_max_inflight_page_reads;
+static my_bool serverless_pageserver_http2;
+static ulong serverless_pageserver_protocol;
+static uint serverless_page_service_port;
+static uint serverless_read_ahead_pages;
+static ulong serverless_pageserver_compression;
+static uint serverless_timeline_info_ttl;
+static double serverless_hedge_percentile;
+static char* serverless_pageserver_urls;
+static uint serverless_pageserver_stripe_pages;
+static uint serverless_wal_group_commit_delay;
+static uint serverless_wal_group_commit_max_bytes;
+static uint serverless_wal_max_batches_in_flight;
+
 // Connection pool is defined in connection_pool.cc
 
 // Storage engine handlerton
@@ -58,20 +91,17 @@ ha_serverless::ha_serverless(handlerton *hton, TABLE_SHARE *table_arg)
   : handler(hton, table_arg),
     pageserver_client(global_pageserver_client),
     safekeeper_client(global_safekeeper_client),
+    pending_wal(nullptr),
+    rows_changed(false),
     current_timeline(0),
-    current_lsn(0)
+    share(nullptr),
+    scan_in_progress(false),
+    read_ahead(serverless_read_ahead_pages)
 {
-    mysql_mutex_init(0, &cache_mutex, MY_MUTEX_INIT_FAST);
 }
 
 ha_serverless::~ha_serverless()
 {
-    // Clean up page cache
-    for (auto& entry : page_cache) {
-        delete entry.second;
-    }
-    page_cache.clear();
-    mysql_mutex_destroy(&cache_mutex);
 }
 
 const char **ha_serverless::bas_ext() const
@@ -84,6 +114,10 @@ int ha_serverless::open(const char *name, int mode, uint test_if_locked)
 {
     DBUG_ENTER("ha_serverless::open");
     
+    if (!(share = get_share())) {
+        DBUG_RETURN(HA_ERR_OUT_OF_MEM);
+    }
+    
     // Initialize timeline for this table
     int result = initialize_timeline(name);
     if (result != 0) {
@@ -96,6 +130,14 @@ int ha_serverless::open(const char *name, int mode, uint test_if_locked)
         DBUG_RETURN(result);
     }
     
+    // The first handler on the table picks up the timeline's LSN
+    if (!share->lsn_loaded) {
+        result = load_timeline_lsn();
+        if (result != 0) {
+            DBUG_RETURN(result);
+        }
+    }
+    
     result = ensure_safekeeper_connection();
     if (result != 0) {
         DBUG_RETURN(result);
@@ -108,17 +150,8 @@ int ha_serverless::close(void)
 {
     DBUG_ENTER("ha_serverless::close");
     
-    // Flush any dirty pages from cache
-    mysql_mutex_lock(&cache_mutex);
-    for (auto& entry : page_cache) {
-        CachedPage* page = entry.second;
-        if (page->dirty) {
-            // Write dirty page to safekeeper
-            write_page_to_safekeeper(page->page_id, page->data);
-        }
-    }
-    mysql_mutex_unlock(&cache_mutex);
-    
+    // Cached pages are owned by the shared page cache and are never
+    // modified in place (all writes go through the safekeeper WAL)
     DBUG_RETURN(0);
 }
 
@@ -130,28 +163,37 @@ int ha_serverless::create(const char *name, TABLE *table_arg,
     // Create timeline for the new table using the connection pool
     TimelineId timeline_id(hash_string(name));
 
-    // Obtain a pageserver connection from the pool
-    auto pageserver_conn = global_connection_pool->get_pageserver_connection();
-    if (!pageserver_conn) {
-        DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
-    }
-
-    // Create timeline on the pageserver
-    if (pageserver_conn->create_timeline(timeline_id) != 0) {
-        DBUG_RETURN(HA_ERR_GENERIC);
+    // Every pageserver shard holds stripes of the timeline
+    for (size_t shard = 0; shard < global_connection_pool->pageserver_shard_count(); ++shard) {
+        PageserverClient* client = global_connection_pool->get_pageserver_connection(shard);
+        if (!client) {
+            DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
+        }
+        
+        PooledPageserverConnection pooled_client(client, global_connection_pool.get());
+        if (pooled_client->create_timeline(timeline_id) != 0) {
+            DBUG_RETURN(HA_ERR_GENERIC);
+        }
     }
 
     // Obtain a safekeeper connection from the pool
-    auto safekeeper_conn = global_connection_pool->get_safekeeper_connection();
+    SafekeeperClient* safekeeper_conn = global_connection_pool->get_safekeeper_connection();
     if (!safekeeper_conn) {
         DBUG_RETURN(HA_ERR_INTERNAL_ERROR);
     }
+    
+    PooledSafekeeperConnection pooled_safekeeper(safekeeper_conn, global_connection_pool.get());
 
     // Create timeline on the safekeeper
-    if (safekeeper_conn->create_timeline(timeline_id) != 0) {
+    if (pooled_safekeeper->create_timeline(timeline_id) != 0) {
         DBUG_RETURN(HA_ERR_GENERIC);
     }
     
+    // Metadata of a dropped table by the same name is void
+    if (global_timeline_info_cache) {
+        global_timeline_info_cache->invalidate(timeline_id);
+    }
+    
     DBUG_RETURN(0);
 }
 
@@ -162,11 +204,32 @@ int ha_serverless::delete_table(const char *name)
     // Delete timeline for table
     TimelineId timeline_id(hash_string(name));
     
-    int result = pageserver_client->delete_timeline(timeline_id);
+    // Remove the stripes from every shard, even if one of them fails
+    int result = 0;
+    for (size_t shard = 0; shard < global_connection_pool->pageserver_shard_count(); ++shard) {
+        PageserverClient* client = global_connection_pool->get_pageserver_connection(shard);
+        if (!client) {
+            result = HA_ERR_GENERIC;
+            continue;
+        }
+        
+        PooledPageserverConnection pooled_client(client, global_connection_pool.get());
+        if (pooled_client->delete_timeline(timeline_id) != 0) {
+            result = HA_ERR_GENERIC;
+        }
+    }
     if (result != 0) {
         DBUG_RETURN(HA_ERR_GENERIC);
     }
     
+    // Drop stale pages so a re-created table does not see them
+    if (global_page_cache) {
+        global_page_cache->invalidate_timeline(timeline_id);
+    }
+    if (global_timeline_info_cache) {
+        global_timeline_info_cache->invalidate(timeline_id);
+    }
+    
     DBUG_RETURN(0);
 }
 
@@ -189,12 +252,14 @@ int ha_serverless::write_row(const uchar *buf)
     
     // For now, implement as a simple append to WAL
     // In production, this would serialize the row data properly
-    WalRecord record(current_lsn++, table->s->reclength, (const char*)buf);
+    WalRecord record(share->allocate_lsn(), table->s->reclength, (const char*)buf);
     
-    int result = safekeeper_client->append_wal_record_async(current_timeline, record);
+    int result = safekeeper_client->append_wal_record_async(current_timeline, record,
+                                                            pending_wal);
     if (result != 0) {
         DBUG_RETURN(HA_ERR_GENERIC);
     }
+    rows_changed = true;
     
     DBUG_RETURN(0);
 }
@@ -205,12 +270,14 @@ int ha_serverless::update_row(const uchar *old_data, const uchar *new_data)
     
     // Implement as WAL record with old and new data
     // For simplicity, just write new data for now
-    WalRecord record(current_lsn++, table->s->reclength, (const char*)new_data);
+    WalRecord record(share->allocate_lsn(), table->s->reclength, (const char*)new_data);
     
-    int result = safekeeper_client->append_wal_record_async(current_timeline, record);
+    int result = safekeeper_client->append_wal_record_async(current_timeline, record,
+                                                            pending_wal);
     if (result != 0) {
         DBUG_RETURN(HA_ERR_GENERIC);
     }
+    rows_changed = true;
     
     DBUG_RETURN(0);
 }
@@ -220,12 +287,14 @@ int ha_serverless::delete_row(const uchar *buf)
     DBUG_ENTER("ha_serverless::delete_row");
     
     // Implement as WAL delete record
-    WalRecord record(current_lsn++, table->s->reclength, (const char*)buf);
+    WalRecord record(share->allocate_lsn(), table->s->reclength, (const char*)buf);
     
-    int result = safekeeper_client->append_wal_record_async(current_timeline, record);
+    int result = safekeeper_client->append_wal_record_async(current_timeline, record,
+                                                            pending_wal);
     if (result != 0) {
         DBUG_RETURN(HA_ERR_GENERIC);
     }
+    rows_changed = true;
     
     DBUG_RETURN(0);
 }
@@ -237,13 +306,26 @@ int ha_serverless::delete_row(const uchar *buf)
 int ha_serverless::rnd_init(bool scan)
 {
     DBUG_ENTER("ha_serverless::rnd_init");
-    // Initialize table scan - for now just return success
+    // Full scans hint the page cache to keep their pages on probation
+    scan_in_progress = scan;
+    read_ahead.reset();
+    
+    // Keep read-ahead within the timeline; its size is usually cached
+    TimelineInfo timeline_info;
+    uint32_t pages = 0;
+    if (read_ahead.enabled() && fetch_timeline_info(&timeline_info) == 0) {
+        uint64_t known = timeline_info.page_count ? timeline_info.page_count :
+            (timeline_info.logical_size + MARIADB_PAGE_SIZE - 1) / MARIADB_PAGE_SIZE;
+        pages = known > UINT32_MAX ? UINT32_MAX : (uint32_t)known;
+    }
+    read_ahead.set_page_limit(pages);
     DBUG_RETURN(0);
 }
 
 int ha_serverless::rnd_end()
 {
     DBUG_ENTER("ha_serverless::rnd_end");
+    scan_in_progress = false;
     DBUG_RETURN(0);
 }
 
@@ -344,12 +426,23 @@ int ha_serverless::info(uint flag)
     DBUG_ENTER("ha_serverless::info");
     
     // Set basic table statistics
-    stats.records = 0;  // Would query pageserver for actual count
+    stats.records = 0;
     stats.deleted = 0;
     stats.data_file_length = 0;
     stats.index_file_length = 0;
     stats.mean_rec_length = table->s->reclength;
     
+    // Size estimates from the timeline metadata; usually served by the
+    // timeline info cache, so the optimizer asking often is cheap
+    TimelineInfo timeline_info;
+    if ((flag & HA_STATUS_VARIABLE) && fetch_timeline_info(&timeline_info) == 0) {
+        stats.data_file_length = timeline_info.logical_size ?
+            timeline_info.logical_size : timeline_info.page_count * MARIADB_PAGE_SIZE;
+        if (stats.mean_rec_length > 0) {
+            stats.records = stats.data_file_length / stats.mean_rec_length;
+        }
+    }
+    
     DBUG_RETURN(0);
 }
 
@@ -363,6 +456,30 @@ ha_rows ha_serverless::records_in_range(uint inx, const key_range *min_key,
 int ha_serverless::external_lock(THD *thd, int lock_type)
 {
     DBUG_ENTER("ha_serverless::external_lock");
+    
+    if (lock_type != F_UNLCK) {
+        register_statement(thd);
+        DBUG_RETURN(0);
+    }
+    
+    // The statement has committed or rolled back, after serverless_commit()
+    // waited for its rows. Either way the cached LSN and size no longer
+    // describe the timeline.
+    if (rows_changed && global_timeline_info_cache) {
+        global_timeline_info_cache->invalidate(current_timeline);
+    }
+    rows_changed = false;
+    pending_wal = nullptr;
+    
+    DBUG_RETURN(0);
+}
+
+int ha_serverless::start_stmt(THD *thd, thr_lock_type lock_type)
+{
+    DBUG_ENTER("ha_serverless::start_stmt");
+    
+    // Under LOCK TABLES statements start here instead of external_lock()
+    register_statement(thd);
     DBUG_RETURN(0);
 }
 
@@ -382,7 +499,90 @@ int ha_serverless::initialize_timeline(const char* table_name)
 {
     // Generate timeline ID from table name
     current_timeline = TimelineId(hash_string(table_name));
-    current_lsn = 1;  // Start from LSN 1
+    return 0;
+}
+
+void ha_serverless::register_statement(THD *thd)
+{
+    // One group per connection collects the rows of all its handlers
+    WalAppendGroup* group = static_cast<WalAppendGroup*>(thd_get_ha_data(thd, ht));
+    if (!group) {
+        group = new WalAppendGroup();
+        thd_set_ha_data(thd, ht, group);
+    }
+    pending_wal = group;
+    
+    // Each statement commits on its own; rows already sent cannot be
+    // rolled back, so the engine stays non-transactional
+    trans_register_ha(thd, false, ht, 0);
+}
+
+Serverless_share* ha_serverless::get_share()
+{
+    Serverless_share* tmp_share;
+    
+    lock_shared_ha_data();
+    tmp_share = static_cast<Serverless_share*>(get_ha_share_ptr());
+    if (!tmp_share) {
+        tmp_share = new (std::nothrow) Serverless_share;
+        if (tmp_share) {
+            set_ha_share_ptr(static_cast<Handler_share*>(tmp_share));
+        }
+    }
+    unlock_shared_ha_data();
+    
+    return tmp_share;
+}
+
+int ha_serverless::load_timeline_lsn()
+{
+    TimelineInfo info;
+    if (fetch_timeline_info(&info) != 0) {
+        sql_print_error("ServerlessDB: Cannot fetch LSN of timeline %llu",
+                        (unsigned long long)current_timeline.id);
+        return HA_ERR_GENERIC;
+    }
+    
+    // Concurrent openers may both get here; the share keeps the maximum
+    share->advance_lsn(info.latest_lsn);
+    share->lsn_loaded = true;
+    return 0;
+}
+
+int ha_serverless::fetch_timeline_info(TimelineInfo* info)
+{
+    uint64_t generation = 0;
+    if (global_timeline_info_cache &&
+        global_timeline_info_cache->lookup(current_timeline, info, &generation)) {
+        return 0;
+    }
+    
+    // Each shard reports the LSNs of the whole timeline but only the
+    // size of its own stripes
+    *info = TimelineInfo();
+    for (size_t shard = 0; shard < global_connection_pool->pageserver_shard_count(); ++shard) {
+        PageserverClient* client = global_connection_pool->get_pageserver_connection(shard);
+        if (!client) {
+            return HA_ERR_GENERIC;
+        }
+        
+        PooledPageserverConnection pooled_client(client, global_connection_pool.get());
+        
+        TimelineInfo shard_info;
+        perf_stats.network_calls++;
+        if (pooled_client->get_timeline_info(current_timeline, &shard_info) != 0) {
+            return HA_ERR_GENERIC;
+        }
+        
+        info->latest_lsn = std::max(info->latest_lsn, shard_info.latest_lsn);
+        info->last_record_lsn = std::max(info->last_record_lsn, shard_info.last_record_lsn);
+        info->page_count += shard_info.page_count;
+        info->logical_size += shard_info.logical_size;
+    }
+    
+    if (global_timeline_info_cache) {
+        global_timeline_info_cache->store(current_timeline, *info, generation);
+    }
     return 0;
 }
 
@@ -406,104 +606,282 @@ int ha_serverless::ensure_safekeeper_connection()
     return 0;
 }
 
-uint64_t ha_serverless::page_key(const PageId& page_id) const
+// Microseconds on the steady clock, for read-ahead timing
+static uint64_t steady_time_us()
 {
-    return (page_id.timeline_id << 32) | page_id.page_number;
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-int ha_serverless::read_page_from_cache_or_pageserver(const PageId& page_id, char* buffer)
+int ha_serverless::pin_page(const PageId& page_id, PageHandle* handle)
 {
-    uint64_t key = page_key(page_id);
+    if (!read_ahead.enabled()) {
+        return pin_single_page(page_id, handle);
+    }
     
-    mysql_mutex_lock(&cache_mutex);
+    // Ask for the pages a sequential reader will want next before
+    // waiting for this one
+    uint32_t first_page;
+    uint32_t count = read_ahead.access(page_id, steady_time_us(), &first_page);
+    if (count > 0) {
+        start_read_ahead(page_id, first_page, count);
+    }
+    
+    int result = pin_single_page(page_id, handle);
+    read_ahead.access_done(steady_time_us());
+    return result;
+}
+
+int ha_serverless::pin_single_page(const PageId& page_id, PageHandle* handle)
+{
+    perf_stats.total_requests++;
     
-    // Check cache first
-    auto it = page_cache.find(key);
-    if (it != page_cache.end()) {
-        CachedPage* page = it->second;
-        memcpy(buffer, page->data, MARIADB_PAGE_SIZE);
-        page->last_access = time(nullptr);
-        mysql_mutex_unlock(&cache_mutex);
+    // Every write made so far on this table must be visible
+    uint64_t read_lsn = share->last_written_lsn;
+    
+    // Check the shared page cache first; hits are read in place, and
+    // a miss leaves us owning the single read of this page
+    switch (global_page_cache->pin(page_id, handle, read_lsn, scan_in_progress)) {
+    case PIN_HIT:
+        perf_stats.cache_hits++;
         return 0;
+    case PIN_NO_FRAME:
+        return HA_ERR_OUT_OF_MEM;
+    case PIN_MISS:
+        break;
     }
     
-    mysql_mutex_unlock(&cache_mutex);
-    
-    // Not in cache, fetch from pageserver using connection pool
+    // Not in cache: read the page straight into the reserved frame
     perf_stats.network_calls++;
     auto start_time = std::chrono::steady_clock::now();
     
-    PageserverClient* client = global_connection_pool->get_pageserver_connection();
+    // A hedging engine duplicates the read if it turns out to be a
+    // straggler, which a pooled connection cannot do
+    if (global_page_fetch_engine && global_page_fetch_engine->hedging()) {
+        PageFetchGroup group;
+        PageFetch fetch;
+        fetch.handle = std::move(*handle);
+        fetch.lsn = read_lsn;
+        fetch.group = &group;
+        group.add();
+        global_page_fetch_engine->submit(&fetch);
+        size_t failures = group.wait();
+        *handle = std::move(fetch.handle);
+        
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time);
+        perf_stats.total_latency_ms += latency.count() / 1000;
+        if (failures > 0) {
+            return HA_ERR_GENERIC;
+        }
+        read_ahead.record_fetch_latency(latency.count());
+        return 0;
+    }
+    
+    PageserverClient* client = global_connection_pool->get_pageserver_connection(
+        global_pageserver_shards->shard_for(page_id));
     if (!client) {
+        handle->release();
         return HA_ERR_GENERIC;
     }
     
     PooledPageserverConnection pooled_client(client, global_connection_pool.get());
-    int result = pooled_client->read_page(page_id, buffer, MARIADB_PAGE_SIZE);
+    int result = pooled_client->read_page(page_id, handle->frame(), MARIADB_PAGE_SIZE, read_lsn);
     
     auto end_time = std::chrono::steady_clock::now();
-    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    perf_stats.total_latency_ms += latency.count();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+    perf_stats.total_latency_ms += latency.count() / 1000;
     if (result == 0) {
-        // Add to cache
-        mysql_mutex_lock(&cache_mutex);
-        if (page_cache.size() >= MAX_CACHED_PAGES) {
-            // Evict LRU page
-            evict_page_from_cache(lru_list.back());
-        }
-        
-        CachedPage* new_page = new CachedPage(page_id);
-        new_page->data = (char*)malloc(MARIADB_PAGE_SIZE);
-        memcpy(new_page->data, buffer, MARIADB_PAGE_SIZE);
-        new_page->last_access = time(nullptr);
-        
-        page_cache[key] = new_page;
-        lru_list.push_front(key);
-        mysql_mutex_unlock(&cache_mutex);
+        read_ahead.record_fetch_latency(latency.count());
+        global_page_cache->publish(handle, read_lsn);
+    } else {
+        handle->release();
     }
     
     return result;
 }
 
-int ha_serverless::write_page_to_safekeeper(const PageId& page_id, const char* data)
+int ha_serverless::pin_pages(const PageId* page_ids, size_t count, PageHandle* handles)
 {
-    perf_stats.network_calls++;
+    if (!global_page_fetch_engine) {
+        // Load the absent pages in one pipelined batch, then pin them
+        // one by one; most of the pins are now hits
+        prefetch_pages(page_ids, count);
+        for (size_t i = 0; i < count; ++i) {
+            int result = pin_page(page_ids[i], &handles[i]);
+            if (result != 0) {
+                return result;
+            }
+        }
+        return 0;
+    }
+    
+    uint64_t read_lsn = share->last_written_lsn;
     auto start_time = std::chrono::steady_clock::now();
     
-    // Get connection from pool
-    SafekeeperClient* client = global_connection_pool->get_safekeeper_connection();
-    if (!client) {
-        return HA_ERR_GENERIC;
+    // Pin everything first so all misses are in flight together
+    PageFetchGroup group;
+    std::vector<PageFetch> fetches(count);
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; ++i) {
+        perf_stats.total_requests++;
+        
+        switch (global_page_cache->pin(page_ids[i], &fetches[i].handle, read_lsn, scan_in_progress)) {
+        case PIN_HIT:
+            perf_stats.cache_hits++;
+            break;
+        case PIN_NO_FRAME:
+            result = HA_ERR_OUT_OF_MEM;
+            break;
+        case PIN_MISS:
+            perf_stats.network_calls++;
+            fetches[i].lsn = read_lsn;
+            fetches[i].group = &group;
+            group.add();
+            global_page_fetch_engine->submit(&fetches[i]);
+            break;
+        }
     }
     
-    PooledSafekeeperConnection pooled_client(client, global_connection_pool.get());
-    
-    // Create WAL record for page write
-    WalRecord record(current_lsn++, MARIADB_PAGE_SIZE, data);
-    int result = pooled_client->append_wal_record(current_timeline, record);
+    if (group.wait() > 0 && result == 0) {
+        result = HA_ERR_GENERIC;
+    }
     
     auto end_time = std::chrono::steady_clock::now();
     auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     perf_stats.total_latency_ms += latency.count();
     
+    for (size_t i = 0; i < count; ++i) {
+        handles[i] = std::move(fetches[i].handle);
+    }
     return result;
 }
 
-void ha_serverless::evict_page_from_cache(uint64_t page_key)
+int ha_serverless::prefetch_pages(const PageId* page_ids, size_t count)
 {
-    auto it = page_cache.find(page_key);
-    if (it != page_cache.end()) {
-        CachedPage* page = it->second;
-        if (page->dirty) {
-            // Write dirty page before eviction
-            write_page_to_safekeeper(page->page_id, page->data);
+    uint64_t read_lsn = share->last_written_lsn;
+    
+    // reserve() never waits, so holding unfilled frames here cannot
+    // deadlock with another reader holding frames we are waiting for
+    std::vector<PageHandle> reserved;
+    reserved.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        reserved.emplace_back();
+        if (!global_page_cache->reserve(page_ids[i], &reserved.back(), read_lsn, scan_in_progress)) {
+            reserved.pop_back();
         }
-        delete page;
-        page_cache.erase(it);
+    }
+    if (reserved.empty()) {
+        return 0;
     }
     
-    // Remove from LRU list
-    lru_list.remove(page_key);
+    // One request per run of pages on the same timeline and shard
+    std::vector<uint32_t> page_numbers;
+    std::vector<char*> frames;
+    int result = 0;
+    size_t run_end;
+    for (size_t run = 0; run < reserved.size(); run = run_end) {
+        uint64_t timeline_id = reserved[run].page_id().timeline_id;
+        size_t shard = global_pageserver_shards->shard_for(reserved[run].page_id());
+        page_numbers.clear();
+        frames.clear();
+        for (run_end = run; run_end < reserved.size() &&
+             reserved[run_end].page_id().timeline_id == timeline_id &&
+             global_pageserver_shards->shard_for(reserved[run_end].page_id()) == shard; ++run_end) {
+            page_numbers.push_back(reserved[run_end].page_id().page_number);
+            frames.push_back(reserved[run_end].frame());
+        }
+        
+        PageserverClient* client = global_connection_pool->get_pageserver_connection(shard);
+        if (!client) {
+            result = HA_ERR_GENERIC;
+            continue;
+        }
+        
+        PooledPageserverConnection pooled_client(client, global_connection_pool.get());
+        
+        perf_stats.network_calls++;
+        if (pooled_client->read_pages(TimelineId(timeline_id), page_numbers.data(),
+                                      frames.data(), frames.size(), read_lsn) != 0) {
+            result = HA_ERR_GENERIC;
+            continue;
+        }
+        for (size_t i = run; i < run_end; ++i) {
+            global_page_cache->publish(&reserved[i], read_lsn);
+        }
+    }
+    
+    // Frames of failed reads are abandoned as the handles go away
+    return result;
+}
+
+void ha_serverless::start_read_ahead(const PageId& page_id, uint32_t first_page, uint32_t count)
+{
+    uint64_t read_lsn = share->last_written_lsn;
+    perf_stats.read_ahead_pages += count;
+    
+    if (global_page_fetch_engine) {
+        uint64_t latency_us = global_page_fetch_engine->average_latency_us();
+        if (latency_us) {
+            read_ahead.record_fetch_latency(latency_us);
+        }
+        
+        // Fire and forget: the engine publishes the pages and frees the
+        // fetches while the reader goes on with the current page
+        for (uint32_t i = 0; i < count; ++i) {
+            PageFetch* fetch = new (std::nothrow) PageFetch;
+            if (!fetch) {
+                return;
+            }
+            if (!global_page_cache->reserve(PageId(page_id.timeline_id, first_page + i),
+                                            &fetch->handle, read_lsn, scan_in_progress)) {
+                delete fetch;   // Cached or already being read
+                continue;
+            }
+            fetch->lsn = read_lsn;
+            perf_stats.network_calls++;
+            global_page_fetch_engine->submit(fetch);
+        }
+        return;
+    }
+    
+    // Without the engine the window is read in one pipelined batch,
+    // together with the page the reader is about to pin
+    std::vector<PageId> page_ids;
+    page_ids.reserve(count + 1);
+    page_ids.push_back(page_id);
+    for (uint32_t i = 0; i < count; ++i) {
+        page_ids.push_back(PageId(page_id.timeline_id, first_page + i));
+    }
+    
+    auto start_time = std::chrono::steady_clock::now();
+    if (prefetch_pages(page_ids.data(), page_ids.size()) == 0) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time);
+        read_ahead.record_fetch_latency(latency.count());
+    }
+}
+
+int ha_serverless::write_page_to_safekeeper(const PageId& page_id, const char* data)
+{
+    perf_stats.network_calls++;
+    auto start_time = std::chrono::steady_clock::now();
+    
+    // The shared client commits the records of all handlers in groups,
+    // so concurrent writers share safekeeper round trips
+    WalRecord record(share->allocate_lsn(), MARIADB_PAGE_SIZE, data);
+    int result = safekeeper_client->append_wal_record(current_timeline, record);
+    
+    // The cached LSN and size no longer describe the timeline
+    if (global_timeline_info_cache) {
+        global_timeline_info_cache->invalidate(current_timeline);
+    }
+    
+    auto end_time = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    perf_stats.total_latency_ms += latency.count();
+    
+    return result;
 }
 
 // Simple string hash function
@@ -517,10 +895,250 @@ static uint64_t hash_string(const char* str)
     return hash;
 }
 
+//
+// System Variables
+//
+
+static MYSQL_SYSVAR_ULONGLONG(page_cache_size, serverless_page_cache_size,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Size in bytes of the page cache shared by all SERVERLESS tables",
+    NULL, NULL, 128ULL << 20, MARIADB_PAGE_SIZE, ~0ULL, MARIADB_PAGE_SIZE);
+
+static MYSQL_SYSVAR_UINT(page_cache_shards, serverless_page_cache_shards,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Number of independently latched page cache partitions "
+    "(rounded down to a power of two)",
+    NULL, NULL, 64, 1, 4096, 0);
+
+static const char* page_cache_policy_names[] = { "LRU", "2Q", NullS };
+
+static TYPELIB page_cache_policy_typelib = {
+    array_elements(page_cache_policy_names) - 1, "page_cache_policy_typelib",
+    page_cache_policy_names, NULL
+};
+
+static MYSQL_SYSVAR_ENUM(page_cache_policy, serverless_page_cache_policy,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Page cache replacement policy. LRU: plain least recently used. "
+    "2Q: scan-resistant, pages must be re-referenced to enter the main LRU",
+    NULL, NULL, PAGE_CACHE_POLICY_2Q, &page_cache_policy_typelib);
+
+static MYSQL_SYSVAR_BOOL(page_cache_large_pages, serverless_page_cache_large_pages,
+    PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_READONLY,
+    "Back page cache frames with 2MB huge pages when available",
+    NULL, NULL, FALSE);
+
+static MYSQL_SYSVAR_STR(local_cache_path, serverless_local_cache_path,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "File on local storage used as a second-tier page cache for pages "
+    "evicted from memory. Empty disables the local cache",
+    NULL, NULL, "");
+
+static MYSQL_SYSVAR_ULONGLONG(local_cache_size, serverless_local_cache_size,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Size in bytes of the local page cache file",
+    NULL, NULL, 1ULL << 30, MARIADB_PAGE_SIZE, ~0ULL, MARIADB_PAGE_SIZE);
+
+static const char* local_cache_admission_names[] = { "ALL", "REUSED", NullS };
+
+static TYPELIB local_cache_admission_typelib = {
+    array_elements(local_cache_admission_names) - 1, "local_cache_admission_typelib",
+    local_cache_admission_names, NULL
+};
+
+static MYSQL_SYSVAR_ENUM(local_cache_admission, serverless_local_cache_admission,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Which pages evicted from memory are written to the local cache. "
+    "ALL: every page. REUSED: only pages that were hit while in memory",
+    NULL, NULL, LOCAL_CACHE_ADMIT_ALL, &local_cache_admission_typelib);
+
+static MYSQL_SYSVAR_STR(page_cache_dump_file, serverless_page_cache_dump_file,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "File the list of hot pages is saved to and reloaded from across "
+    "restarts. Empty disables page cache dump and load",
+    NULL, NULL, "serverless_page_cache");
+
+static MYSQL_SYSVAR_UINT(page_cache_dump_interval, serverless_page_cache_dump_interval,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Seconds between page cache dumps. 0 dumps at shutdown only",
+    NULL, NULL, 300, 0, 86400, 0);
+
+static MYSQL_SYSVAR_BOOL(page_cache_load_at_startup, serverless_page_cache_load_at_startup,
+    PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_READONLY,
+    "Prefetch the pages listed in the page cache dump file in the "
+    "background when the engine starts",
+    NULL, NULL, TRUE);
+
+static MYSQL_SYSVAR_UINT(max_inflight_page_reads, serverless_max_inflight_page_reads,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Maximum number of page reads the fetch engine keeps in flight "
+    "concurrently. 0 disables the engine; misses are then read one at "
+    "a time over pooled connections",
+    NULL, NULL, 256, 0, 4096, 0);
+
+static MYSQL_SYSVAR_BOOL(pageserver_http2, serverless_pageserver_http2,
+    PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_READONLY,
+    "Multiplex concurrent page reads as HTTP/2 streams over a few "
+    "connections (h2c with prior knowledge; the pageserver must "
+    "accept HTTP/2 without upgrade)",
+    NULL, NULL, FALSE);
+
+static const char* pageserver_protocol_names[] = { "HTTP", "BINARY", NullS };
+
+static TYPELIB pageserver_protocol_typelib = {
+    array_elements(pageserver_protocol_names) - 1, "pageserver_protocol_typelib",
+    pageserver_protocol_names, NULL
+};
+
+static MYSQL_SYSVAR_ENUM(pageserver_protocol, serverless_pageserver_protocol,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Protocol used to read pages. HTTP: the pageserver HTTP API. "
+    "BINARY: pipelined binary page service over persistent TCP "
+    "connections (the concurrent fetch engine is not used)",
+    NULL, NULL, PAGESERVER_PROTOCOL_HTTP, &pageserver_protocol_typelib);
+
+static MYSQL_SYSVAR_UINT(page_service_port, serverless_page_service_port,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Pageserver port of the binary page service",
+    NULL, NULL, 6400, 1, 65535, 0);
+
+static MYSQL_SYSVAR_UINT(read_ahead_pages, serverless_read_ahead_pages,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Maximum number of pages requested ahead of a sequential reader. "
+    "The window adapts to pageserver latency and scan speed up to this "
+    "limit. 0 disables read-ahead",
+    NULL, NULL, 64, 0, 1024, 0);
+
+static const char* pageserver_compression_names[] = { "NONE", "LZ4", "ZSTD", NullS };
+
+static TYPELIB pageserver_compression_typelib = {
+    array_elements(pageserver_compression_names) - 1, "pageserver_compression_typelib",
+    pageserver_compression_names, NULL
+};
+
+static MYSQL_SYSVAR_ENUM(pageserver_compression, serverless_pageserver_compression,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Compression requested for page images read from the pageserver. "
+    "LZ4 costs the least CPU, ZSTD saves the most bandwidth; the "
+    "pageserver may still send pages that do not shrink uncompressed",
+    NULL, NULL, PAGE_COMPRESSION_NONE, &pageserver_compression_typelib);
+
+static MYSQL_SYSVAR_UINT(timeline_info_ttl, serverless_timeline_info_ttl,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Seconds timeline metadata (LSN, size) fetched from the pageserver "
+    "is reused for table statistics before being fetched again. Writes "
+    "to the table invalidate it early. 0 disables caching",
+    NULL, NULL, 5, 0, 3600, 0);
+
+static MYSQL_SYSVAR_DOUBLE(hedge_percentile, serverless_hedge_percentile,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Send a duplicate page request when a read is still running after "
+    "this percentile of recent read latencies (e.g. 95 or 99.9), and use "
+    "whichever answer arrives first. Requires the fetch engine. 0 "
+    "disables hedging",
+    NULL, NULL, 0, 0, 99.99, 0);
+
+static MYSQL_SYSVAR_STR(pageserver_urls, serverless_pageserver_urls,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Comma separated base URLs of the pageservers. With more than one, "
+    "the pages of every table are striped over them and each gets its "
+    "own connection pool",
+    NULL, NULL, "http://localhost:9997");
+
+static MYSQL_SYSVAR_UINT(pageserver_stripe_pages, serverless_pageserver_stripe_pages,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Number of consecutive pages of a table stored on the same "
+    "pageserver before moving on to the next one",
+    NULL, NULL, 256, 1, 1U << 20, 0);
+
+static MYSQL_SYSVAR_UINT(wal_group_commit_delay, serverless_wal_group_commit_delay,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Microseconds the WAL writer waits for more records before sending "
+    "a batch to the safekeeper. 0 sends whatever was queued while the "
+    "previous batch was in flight",
+    NULL, NULL, 0, 0, 100000, 0);
+
+static MYSQL_SYSVAR_UINT(wal_group_commit_max_bytes, serverless_wal_group_commit_max_bytes,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "Maximum bytes of WAL records sent to the safekeeper in one batch; "
+    "a batch this large is sent without waiting out the delay",
+    NULL, NULL, 1U << 20, MARIADB_PAGE_SIZE, 1U << 30, 0);
+
+static MYSQL_SYSVAR_UINT(wal_max_batches_in_flight, serverless_wal_max_batches_in_flight,
+    PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+    "WAL batches sent to the safekeeper before the first of them is "
+    "acknowledged. Full batches are streamed behind unacknowledged "
+    "ones up to this limit; 1 waits for every acknowledgement. At most "
+    "16, the full batches the client's submission ring holds",
+    NULL, NULL, 8, 1, 16, 0);
+
+static struct st_mysql_sys_var* serverless_system_variables[] = {
+    MYSQL_SYSVAR(page_cache_size),
+    MYSQL_SYSVAR(page_cache_shards),
+    MYSQL_SYSVAR(page_cache_policy),
+    MYSQL_SYSVAR(page_cache_large_pages),
+    MYSQL_SYSVAR(local_cache_path),
+    MYSQL_SYSVAR(local_cache_size),
+    MYSQL_SYSVAR(local_cache_admission),
+    MYSQL_SYSVAR(page_cache_dump_file),
+    MYSQL_SYSVAR(page_cache_dump_interval),
+    MYSQL_SYSVAR(page_cache_load_at_startup),
+    MYSQL_SYSVAR(max_inflight_page_reads),
+    MYSQL_SYSVAR(pageserver_http2),
+    MYSQL_SYSVAR(pageserver_protocol),
+    MYSQL_SYSVAR(page_service_port),
+    MYSQL_SYSVAR(read_ahead_pages),
+    MYSQL_SYSVAR(pageserver_compression),
+    MYSQL_SYSVAR(timeline_info_ttl),
+    MYSQL_SYSVAR(hedge_percentile),
+    MYSQL_SYSVAR(pageserver_urls),
+    MYSQL_SYSVAR(pageserver_stripe_pages),
+    MYSQL_SYSVAR(wal_group_commit_delay),
+    MYSQL_SYSVAR(wal_group_commit_max_bytes),
+    MYSQL_SYSVAR(wal_max_batches_in_flight),
+    NULL
+};
+
 //
 // Plugin Registration and Initialization
 //
 
+// Statement commit: the rows written by the statement must be
+// durable before the client is told it succeeded
+static int serverless_commit(handlerton *hton, THD *thd, bool all)
+{
+    WalAppendGroup* group = static_cast<WalAppendGroup*>(thd_get_ha_data(thd, hton));
+    if (!group) {
+        return 0;
+    }
+    
+    size_t failed = group->wait();
+    if (failed > 0) {
+        sql_print_error("ServerlessDB: %zu WAL records were not acknowledged by the safekeeper",
+                        failed);
+        return HA_ERR_GENERIC;
+    }
+    return 0;
+}
+
+// Rows already sent cannot be taken back; only settle the group
+static int serverless_rollback(handlerton *hton, THD *thd, bool all)
+{
+    WalAppendGroup* group = static_cast<WalAppendGroup*>(thd_get_ha_data(thd, hton));
+    if (group) {
+        group->wait();
+    }
+    return 0;
+}
+
+static int serverless_close_connection(handlerton *hton, THD *thd)
+{
+    // The group waits for records still queued before it goes
+    delete static_cast<WalAppendGroup*>(thd_get_ha_data(thd, hton));
+    thd_set_ha_data(thd, hton, nullptr);
+    return 0;
+}
+
 static handler* serverless_create_handler(handlerton *hton, TABLE_SHARE *table,
                                          MEM_ROOT *mem_root)
 {
@@ -533,17 +1151,90 @@ static int serverless_init_func(void *p)
     
     serverless_hton = (handlerton *)p;
     serverless_hton->create = serverless_create_handler;
+    serverless_hton->commit = serverless_commit;
+    serverless_hton->rollback = serverless_rollback;
+    serverless_hton->close_connection = serverless_close_connection;
     serverless_hton->flags = HTON_CAN_RECREATE;
     serverless_hton->db_type = DB_TYPE_AUTOASSIGN;
     
+    // Shared page cache used by every handler
+    global_page_cache.reset(new PageCache(serverless_page_cache_size,
+                                          serverless_page_cache_shards,
+                                          (PageCachePolicy)serverless_page_cache_policy,
+                                          serverless_page_cache_large_pages));
+    
+    if (!global_page_cache->initialize()) {
+        sql_print_error("ServerlessDB: Failed to allocate %llu bytes for the page cache",
+                        serverless_page_cache_size);
+        global_page_cache.reset();
+        DBUG_RETURN(1);
+    }
+    
+    if (serverless_page_cache_large_pages && !global_page_cache->get_stats().large_pages) {
+        sql_print_warning("ServerlessDB: Huge pages unavailable, page cache uses regular pages");
+    }
+    
+    // Optional second tier on local storage
+    if (serverless_local_cache_path && *serverless_local_cache_path) {
+        global_local_file_cache.reset(new LocalFileCache(
+            serverless_local_cache_path, serverless_local_cache_size,
+            (LocalCacheAdmission)serverless_local_cache_admission));
+        
+        if (global_local_file_cache->initialize()) {
+            global_page_cache->set_second_tier(global_local_file_cache.get());
+        } else {
+            sql_print_warning("ServerlessDB: Cannot use local cache file %s, continuing without it",
+                              serverless_local_cache_path);
+            global_local_file_cache.reset();
+        }
+    }
+    
+    // Table statistics without a pageserver round trip per call
+    if (serverless_timeline_info_ttl > 0) {
+        global_timeline_info_cache.reset(new TimelineInfoCache(
+            std::chrono::seconds(serverless_timeline_info_ttl)));
+    }
+    
+    // Where each page is read from
+    global_pageserver_shards.reset(new PageserverShardMap(serverless_pageserver_stripe_pages));
+    if (!global_pageserver_shards->initialize(serverless_pageserver_urls)) {
+        sql_print_error("ServerlessDB: Invalid pageserver URL list '%s'",
+                        serverless_pageserver_urls ? serverless_pageserver_urls : "");
+        global_pageserver_shards.reset();
+        DBUG_RETURN(1);
+    }
+    
+    if (serverless_pageserver_protocol == PAGESERVER_PROTOCOL_BINARY) {
+        global_pageserver_shards->set_page_service(serverless_page_service_port);
+    }
+    
+    if (global_pageserver_shards->shard_count() > 1) {
+        sql_print_information("ServerlessDB: Pages striped over %zu pageservers, %u pages per stripe",
+                              global_pageserver_shards->shard_count(),
+                              serverless_pageserver_stripe_pages);
+    }
+    
     // Initialize connection pool for optimal performance
     global_connection_pool.reset(new ConnectionPool(
-        5,   // min pageserver connections
-        20,  // max pageserver connections  
+        5,   // min pageserver connections per shard
+        20,  // max pageserver connections per shard
         3,   // min safekeeper connections
         10   // max safekeeper connections
     ));
     
+    global_connection_pool->set_pageserver_shards(*global_pageserver_shards);
+    global_connection_pool->set_wal_group_commit(serverless_wal_group_commit_delay,
+                                                 serverless_wal_group_commit_max_bytes);
+    global_connection_pool->set_wal_pipelining(serverless_wal_max_batches_in_flight);
+    
+    PageCompression page_compression = (PageCompression)serverless_pageserver_compression;
+    if (!page_compression_available(page_compression)) {
+        sql_print_warning("ServerlessDB: Engine built without %s support, pages are transferred uncompressed",
+                          pageserver_compression_names[page_compression]);
+        page_compression = PAGE_COMPRESSION_NONE;
+    }
+    global_connection_pool->set_page_compression(page_compression);
+    
     if (!global_connection_pool->initialize()) {
         sql_print_error("ServerlessDB: Failed to initialize connection pool");
         DBUG_RETURN(1);
@@ -552,9 +1243,42 @@ static int serverless_init_func(void *p)
     // Pre-warm connections for zero cold start
     global_connection_pool->warm_connections();
     
+    // Concurrent page reads for multi-page requests (HTTP only; the
+    // binary protocol pipelines batches over pooled connections)
+    if (serverless_max_inflight_page_reads > 0 &&
+        serverless_pageserver_protocol == PAGESERVER_PROTOCOL_HTTP) {
+        global_page_fetch_engine.reset(new PageFetchEngine(global_pageserver_shards.get(),
+                                                           serverless_max_inflight_page_reads,
+                                                           serverless_pageserver_http2));
+        global_page_fetch_engine->set_compression(page_compression);
+        global_page_fetch_engine->set_hedging(serverless_hedge_percentile);
+        if (!global_page_fetch_engine->initialize()) {
+            sql_print_warning("ServerlessDB: Cannot start page fetch engine, reading pages serially");
+            global_page_fetch_engine.reset();
+        }
+    }
+    
+    if (serverless_hedge_percentile > 0 && !global_page_fetch_engine) {
+        sql_print_warning("ServerlessDB: Hedged page reads need the page fetch engine, hedging is off");
+    }
+    
+    // Reload the previous working set in the background and keep the
+    // hot page list on disk up to date
+    if (serverless_page_cache_dump_file && *serverless_page_cache_dump_file) {
+        global_page_cache_warmer.reset(new PageCacheWarmer(
+            serverless_page_cache_dump_file,
+            std::chrono::seconds(serverless_page_cache_dump_interval),
+            serverless_page_cache_load_at_startup,
+            global_page_cache->get_stats().capacity_pages));
+        global_page_cache_warmer->start();
+    }
+    
     // Initialize legacy clients for compatibility
-    global_pageserver_client = new PageserverClient("http://localhost:9997");
+    global_pageserver_client = new PageserverClient(global_pageserver_shards->shard(0).url.c_str());
     global_safekeeper_client = new SafekeeperClient("localhost", 5433);
+    global_safekeeper_client->set_group_commit(serverless_wal_group_commit_delay,
+                                               serverless_wal_group_commit_max_bytes);
+    global_safekeeper_client->set_max_batches_in_flight(serverless_wal_max_batches_in_flight);
     
     sql_print_information("ServerlessDB: Storage engine initialized with connection pooling");
     DBUG_RETURN(0);
@@ -564,6 +1288,39 @@ static int serverless_done_func(void *p)
 {
     DBUG_ENTER("serverless_done_func");
     
+    // Save the hot page list while the cache is still populated
+    if (global_page_cache_warmer) {
+        global_page_cache_warmer->stop();
+        global_page_cache_warmer.reset();
+    }
+    
+    // Completes or fails every outstanding read while the cache exists
+    if (global_page_fetch_engine) {
+        auto fetch_stats = global_page_fetch_engine->get_stats();
+        sql_print_information("ServerlessDB: Final stats - Page fetches: %llu, failed: %llu, peak in flight: %llu, average latency: %llu us, hedged: %llu (won %llu) (%s)",
+                             (unsigned long long)fetch_stats.completed,
+                             (unsigned long long)fetch_stats.failed,
+                             (unsigned long long)fetch_stats.peak_in_flight,
+                             (unsigned long long)fetch_stats.average_latency_us,
+                             (unsigned long long)fetch_stats.hedges_issued,
+                             (unsigned long long)fetch_stats.hedges_won,
+                             fetch_stats.http2 ? "HTTP/2" : "HTTP/1.1");
+        global_page_fetch_engine->shutdown();
+        global_page_fetch_engine.reset();
+    }
+    
+    sql_print_information("ServerlessDB: Final stats - Read-ahead pages requested: %llu",
+                          (unsigned long long)perf_stats.read_ahead_pages.load());
+    
+    auto compression_stats = get_page_compression_stats();
+    if (compression_stats.pages > 0) {
+        sql_print_information("ServerlessDB: Final stats - Compressed pages: %llu, bytes received: %llu, bytes saved: %llu",
+                              (unsigned long long)compression_stats.pages,
+                              (unsigned long long)compression_stats.compressed_bytes,
+                              (unsigned long long)(compression_stats.uncompressed_bytes -
+                                                   compression_stats.compressed_bytes));
+    }
+    
     // Shutdown connection pool
     if (global_connection_pool) {
         auto stats = global_connection_pool->get_stats();
@@ -574,7 +1331,47 @@ static int serverless_done_func(void *p)
         global_connection_pool.reset();
     }
     
-    // Cleanup legacy clients
+    // Released after the fetch engine and the pool, which route through it
+    global_pageserver_shards.reset();
+    
+    if (global_timeline_info_cache) {
+        auto info_stats = global_timeline_info_cache->get_stats();
+        sql_print_information("ServerlessDB: Final stats - Timeline info cache hits: %llu, misses: %llu, invalidations: %llu",
+                             (unsigned long long)info_stats.hits,
+                             (unsigned long long)info_stats.misses,
+                             (unsigned long long)info_stats.invalidations);
+        global_timeline_info_cache.reset();
+    }
+    
+    // Release the shared page cache
+    if (global_page_cache) {
+        auto cache_stats = global_page_cache->get_stats();
+        sql_print_information("ServerlessDB: Final stats - Page cache hit rate: %.2f%%, evictions: %llu, stale reads: %llu",
+                             cache_stats.hit_rate * 100, (unsigned long long)cache_stats.evictions,
+                             (unsigned long long)cache_stats.stale_reads);
+        global_page_cache.reset();
+    }
+    
+    if (global_local_file_cache) {
+        auto local_stats = global_local_file_cache->get_stats();
+        sql_print_information("ServerlessDB: Final stats - Local cache hits: %llu, misses: %llu",
+                             (unsigned long long)local_stats.hits,
+                             (unsigned long long)local_stats.misses);
+        global_local_file_cache.reset();
+    }
+    
+    if (global_safekeeper_client) {
+        auto wal_stats = global_safekeeper_client->get_stats();
+        sql_print_information("ServerlessDB: Final stats - WAL records: %llu in %llu batches (%.1f per batch), bytes: %llu, failed batches: %llu",
+                             (unsigned long long)wal_stats.records,
+                             (unsigned long long)wal_stats.batches,
+                             wal_stats.batches ? (double)wal_stats.records / wal_stats.batches : 0.0,
+                             (unsigned long long)wal_stats.bytes,
+                             (unsigned long long)wal_stats.failed_batches);
+    }
+    
+    // Cleanup legacy clients; the safekeeper client sends the WAL
+    // still queued before it goes
     delete global_pageserver_client;
     delete global_safekeeper_client;
     global_pageserver_client = nullptr;
@@ -599,7 +1396,7 @@ maria_declare_plugin(serverless)
     serverless_done_func,    /* Plugin Deinit */
     0x0100,                  /* version 1.0 */
     NULL,                    /* status variables */
-    NULL,                    /* system variables */
+    serverless_system_variables, /* system variables */
     "1.0",                   /* string version */
     MariaDB_PLUGIN_MATURITY_EXPERIMENTAL /* maturity */
 }
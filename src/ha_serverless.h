@@ -35,29 +35,44 @@
 #include "sql_class.h"
 
 // C++ standard library includes
-#include <unordered_map>
-#include <list>
-#include <ctime>
+#include <atomic>
 #include <cstdlib>
 
 // Common type definitions
 #include "serverless_types.h"
+#include "read_ahead.h"
 
 // Forward declarations for our clients
 class PageserverClient;
 class SafekeeperClient;
+class WalAppendGroup;
+class PageHandle;
 
-// Page cache entry
-struct CachedPage {
-    PageId page_id;
-    char* data;             // 16KB page data
-    uint64_t lsn;           // LSN when page was cached
-    bool dirty;             // Whether page has been modified
-    time_t last_access;     // For LRU eviction
-    
-    CachedPage(const PageId& id) 
-        : page_id(id), data(nullptr), lsn(0), dirty(false), last_access(0) {}
-    ~CachedPage() { if (data) free(data); }
+/**
+ * State shared by every handler open on the same table
+ *
+ * Holds the timeline's LSN so that all connections writing the table
+ * allocate from one sequence, and readers know which LSN cached
+ * pages must have reached to include every write made so far.
+ */
+class Serverless_share : public Handler_share {
+public:
+    // Last LSN assigned to a WAL record of this timeline
+    std::atomic<uint64_t> last_written_lsn;
+    // Set once the starting LSN has been fetched from the pageserver
+    std::atomic<bool> lsn_loaded;
+
+    Serverless_share() : last_written_lsn(0), lsn_loaded(false) {}
+
+    // LSN for the next WAL record
+    uint64_t allocate_lsn() { return last_written_lsn.fetch_add(1) + 1; }
+
+    // Move the LSN forward to at least lsn
+    void advance_lsn(uint64_t lsn) {
+        uint64_t current = last_written_lsn.load();
+        while (current < lsn && !last_written_lsn.compare_exchange_weak(current, lsn)) {
+        }
+    }
 };
 
 /**
@@ -75,23 +90,44 @@ private:
     PageserverClient* pageserver_client;
     SafekeeperClient* safekeeper_client;
     
+    // Rows sent to the safekeeper and not yet known to be durable;
+    // the connection's group, waited for when the statement commits
+    WalAppendGroup* pending_wal;
+    
+    // The current statement appended rows to the timeline's WAL
+    bool rows_changed;
+    
     // Current table timeline
     TimelineId current_timeline;
     
-    // Page cache (LRU with configurable size)
-    static const size_t MAX_CACHED_PAGES = 1024;
-    std::unordered_map<uint64_t, CachedPage*> page_cache;
-    std::list<uint64_t> lru_list;
-    mutable mysql_mutex_t cache_mutex;
+    // Per-table shared state (WAL tracking)
+    Serverless_share* share;
+    
+    // Set between rnd_init(true) and rnd_end(): page references come
+    // from a sequential scan and must not displace the cache hot set
+    bool scan_in_progress;
     
-    // WAL tracking
-    uint64_t current_lsn;
+    // Sequential access detection for this handler's page reads
+    ReadAhead read_ahead;
     
     // Helper methods
-    int read_page_from_cache_or_pageserver(const PageId& page_id, char* buffer);
+    Serverless_share* get_share();
+    // Join the statement transaction, so its commit waits for our rows
+    void register_statement(THD *thd);
+    int load_timeline_lsn();
+    // Metadata of the current timeline, cached when possible
+    int fetch_timeline_info(TimelineInfo* info);
+    int pin_page(const PageId& page_id, PageHandle* handle);
+    int pin_single_page(const PageId& page_id, PageHandle* handle);
+    // Request pages first_page.. of page_id's timeline ahead of a
+    // sequential reader currently at page_id
+    void start_read_ahead(const PageId& page_id, uint32_t first_page, uint32_t count);
+    // Pin many pages, reading all misses concurrently; on error some
+    // handles may still be pinned and are released by the caller
+    int pin_pages(const PageId* page_ids, size_t count, PageHandle* handles);
+    // Load pages not yet cached without pinning them
+    int prefetch_pages(const PageId* page_ids, size_t count);
     int write_page_to_safekeeper(const PageId& page_id, const char* data);
-    void evict_page_from_cache(uint64_t page_key);
-    uint64_t page_key(const PageId& page_id) const;
     
 public:
     ha_serverless(handlerton *hton, TABLE_SHARE *table_arg);
@@ -140,6 +176,7 @@ public:
     
     // Transaction support
     int external_lock(THD *thd, int lock_type);
+    int start_stmt(THD *thd, thr_lock_type lock_type);
     THR_LOCK_DATA **store_lock(THD *thd, THR_LOCK_DATA **to,
                                enum thr_lock_type lock_type);
     
@@ -0,0 +1,207 @@
+/*
+  Local File Cache Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Disk-backed second tier for the page cache
+*/
+
+#include "local_file_cache.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Global local file cache instance
+std::unique_ptr<LocalFileCache> global_local_file_cache;
+
+LocalFileCache::LocalFileCache(const char* path, size_t capacity_bytes,
+                               LocalCacheAdmission policy)
+    : file_path(strdup(path)), fd(-1),
+      capacity_pages(capacity_bytes / MARIADB_PAGE_SIZE), admission(policy),
+      clock_hand(0), invalidations(0), hits(0), misses(0), writes(0)
+{
+}
+
+LocalFileCache::~LocalFileCache()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(file_path);
+}
+
+bool LocalFileCache::initialize()
+{
+    if (capacity_pages == 0) {
+        return false;
+    }
+
+    // Frames come from the 4KB aligned page arena, so bypass the OS
+    // page cache where the file system allows it
+#ifdef O_DIRECT
+    fd = open(file_path, O_RDWR | O_CREAT | O_DIRECT, 0660);
+#endif
+    if (fd < 0) {
+        fd = open(file_path, O_RDWR | O_CREAT, 0660);
+    }
+    if (fd < 0) {
+        return false;
+    }
+
+    off_t bytes = (off_t)capacity_pages * MARIADB_PAGE_SIZE;
+    if (posix_fallocate(fd, 0, bytes) != 0 && ftruncate(fd, bytes) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    slots.resize(capacity_pages);
+    index.reserve(capacity_pages);
+    return true;
+}
+
+bool LocalFileCache::read(const PageId& page_id, char* frame, uint64_t min_lsn,
+                          uint64_t* lsn)
+{
+    uint32_t slot_number;
+
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        auto it = index.find(PageKey(page_id));
+        // A stale image is left for write() to replace with a newer one
+        if (it == index.end() || slots[it->second].lsn < min_lsn) {
+            misses++;
+            return false;
+        }
+
+        slot_number = it->second;
+        Slot& slot = slots[slot_number];
+        slot.readers++;
+        slot.referenced = true;
+        *lsn = slot.lsn;
+    }
+
+    ssize_t bytes = pread(fd, frame, MARIADB_PAGE_SIZE,
+                          (off_t)slot_number * MARIADB_PAGE_SIZE);
+
+    std::lock_guard<std::mutex> lock(index_mutex);
+    slots[slot_number].readers--;
+    if (bytes != (ssize_t)MARIADB_PAGE_SIZE) {
+        misses++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+bool LocalFileCache::claim_slot(uint32_t* slot_number)
+{
+    // CLOCK sweep; two passes clear every reference bit at most once
+    for (size_t step = 0; step < 2 * slots.size(); ++step) {
+        Slot& slot = slots[clock_hand];
+        uint32_t candidate = (uint32_t)clock_hand;
+        clock_hand = (clock_hand + 1) % slots.size();
+
+        if (slot.writing || slot.readers > 0) {
+            continue;
+        }
+        if (slot.used && slot.referenced) {
+            slot.referenced = false;
+            continue;
+        }
+
+        if (slot.used) {
+            index.erase(slot.key);
+            slot.used = false;
+        }
+        *slot_number = candidate;
+        return true;
+    }
+    return false;
+}
+
+void LocalFileCache::write(const PageId& page_id, const char* frame, uint64_t lsn,
+                           bool reused, uint64_t generation)
+{
+    if (admission == LOCAL_CACHE_ADMIT_REUSED && !reused) {
+        return;
+    }
+
+    PageKey key(page_id);
+    uint32_t slot_number;
+
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        if (generation != invalidations) {
+            return;
+        }
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            Slot& slot = slots[it->second];
+            // Clean pages loaded from this file need no rewrite
+            if (slot.lsn == lsn) {
+                slot.referenced = true;
+                return;
+            }
+            if (slot.readers > 0) {
+                return;
+            }
+            slot_number = it->second;
+            index.erase(it);
+        } else if (!claim_slot(&slot_number)) {
+            return;
+        }
+
+        Slot& slot = slots[slot_number];
+        slot.key = key;
+        slot.lsn = lsn;
+        slot.used = false;
+        slot.writing = true;
+    }
+
+    ssize_t bytes = pwrite(fd, frame, MARIADB_PAGE_SIZE,
+                           (off_t)slot_number * MARIADB_PAGE_SIZE);
+
+    std::lock_guard<std::mutex> lock(index_mutex);
+    Slot& slot = slots[slot_number];
+    slot.writing = false;
+    // Drop the page if a timeline was invalidated during the write
+    if (bytes == (ssize_t)MARIADB_PAGE_SIZE && generation == invalidations &&
+        !index.count(key)) {
+        slot.used = true;
+        slot.referenced = false;
+        index[key] = slot_number;
+        writes++;
+    }
+}
+
+void LocalFileCache::invalidate_timeline(const TimelineId& timeline_id)
+{
+    std::lock_guard<std::mutex> lock(index_mutex);
+    invalidations++;
+
+    auto it = index.begin();
+    while (it != index.end()) {
+        if (it->first.timeline_id == timeline_id.id) {
+            slots[it->second].used = false;
+            it = index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+LocalFileCache::LocalCacheStats LocalFileCache::get_stats()
+{
+    LocalCacheStats stats;
+
+    std::lock_guard<std::mutex> lock(index_mutex);
+    stats.capacity_pages = capacity_pages;
+    stats.cached_pages = index.size();
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.writes = writes;
+
+    return stats;
+}
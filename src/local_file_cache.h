@@ -0,0 +1,112 @@
+/*
+  Local File Cache for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Disk-backed second tier behind the in-memory page cache. Clean pages
+  evicted from memory are kept in a preallocated file on local storage
+  so that a later miss is served from disk instead of the pageserver.
+*/
+
+#ifndef LOCAL_FILE_CACHE_H
+#define LOCAL_FILE_CACHE_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+#include "page_cache.h"
+
+// Which evicted pages are written to the file (serverless_local_cache_admission)
+enum LocalCacheAdmission {
+    LOCAL_CACHE_ADMIT_ALL = 0,      // Every evicted page
+    LOCAL_CACHE_ADMIT_REUSED = 1    // Only pages hit at least once in memory
+};
+
+/**
+ * Local File Cache
+ *
+ * The file is divided into 16KB slots; an in-memory index maps
+ * (timeline, page) to a slot. Slots are replaced with CLOCK. The
+ * index is not persisted, so the file starts empty on every boot.
+ */
+class LocalFileCache {
+private:
+    struct Slot {
+        PageKey key;
+        uint64_t lsn;
+        uint32_t readers;   // Threads copying the slot out of the file
+        bool used;
+        bool writing;       // Being filled; not yet in the index
+        bool referenced;    // CLOCK reference bit
+
+        Slot() : key(PageId(0, 0)), lsn(0), readers(0),
+                 used(false), writing(false), referenced(false) {}
+    };
+
+    char* file_path;
+    int fd;
+    size_t capacity_pages;
+    LocalCacheAdmission admission;
+
+    std::mutex index_mutex;
+    std::unordered_map<PageKey, uint32_t, PageKeyHash> index;
+    std::vector<Slot> slots;
+    size_t clock_hand;
+    std::atomic<uint64_t> invalidations;    // Bumped by invalidate_timeline()
+
+    // Statistics (protected by index_mutex)
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writes;
+
+    bool claim_slot(uint32_t* slot_number);
+
+public:
+    LocalFileCache(const char* path, size_t capacity_bytes, LocalCacheAdmission policy);
+    ~LocalFileCache();
+
+    // Open and preallocate the cache file
+    bool initialize();
+
+    // Read a page into frame if the stored image is at least min_lsn;
+    // returns true and the image LSN on hit
+    bool read(const PageId& page_id, char* frame, uint64_t min_lsn, uint64_t* lsn);
+
+    // Offer a page evicted from memory. generation is the value of
+    // generation() when the page left memory; pages whose timeline
+    // was invalidated since then are dropped.
+    void write(const PageId& page_id, const char* frame, uint64_t lsn, bool reused,
+               uint64_t generation);
+    uint64_t generation() const { return invalidations; }
+
+    // Forget every page belonging to a timeline
+    void invalidate_timeline(const TimelineId& timeline_id);
+
+    // Statistics and monitoring
+    struct LocalCacheStats {
+        size_t capacity_pages;
+        size_t cached_pages;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t writes;
+    };
+
+    LocalCacheStats get_stats();
+};
+
+// Global local file cache instance (null when disabled)
+extern std::unique_ptr<LocalFileCache> global_local_file_cache;
+
+#endif /* LOCAL_FILE_CACHE_H */
@@ -0,0 +1,96 @@
+/*
+  Page Frame Arena Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Pre-allocated page frames and descriptors for the page cache
+*/
+
+#include "page_arena.h"
+#include "page_cache.h"
+#include <new>
+#include <sys/mman.h>
+
+// Huge page size used for the frame mapping when requested
+static const size_t LARGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+PageFrameArena::PageFrameArena()
+    : frames(nullptr), mapped_bytes(0), frame_count(0),
+      large_pages(false), descriptors(nullptr)
+{
+}
+
+PageFrameArena::~PageFrameArena()
+{
+    release();
+}
+
+bool PageFrameArena::allocate(size_t count, bool use_large_pages)
+{
+    release();
+
+    size_t bytes = count * MARIADB_PAGE_SIZE;
+    void* mapping = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (use_large_pages) {
+        size_t rounded = (bytes + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+        mapping = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED) {
+            mapped_bytes = rounded;
+            large_pages = true;
+        }
+    }
+#endif
+
+    if (mapping == MAP_FAILED) {
+        // Regular pages; let transparent huge pages back them if possible
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        mapped_bytes = bytes;
+#ifdef MADV_HUGEPAGE
+        if (use_large_pages) {
+            madvise(mapping, bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    descriptors = new (std::nothrow) CachedPage[count];
+    if (!descriptors) {
+        munmap(mapping, mapped_bytes);
+        mapped_bytes = 0;
+        large_pages = false;
+        return false;
+    }
+
+    frames = (char*)mapping;
+    frame_count = count;
+
+    for (size_t i = 0; i < count; ++i) {
+        descriptors[i].data = frames + i * MARIADB_PAGE_SIZE;
+    }
+
+    return true;
+}
+
+void PageFrameArena::release()
+{
+    delete[] descriptors;
+    descriptors = nullptr;
+
+    if (frames) {
+        munmap(frames, mapped_bytes);
+        frames = nullptr;
+    }
+    mapped_bytes = 0;
+    frame_count = 0;
+    large_pages = false;
+}
+
+CachedPage* PageFrameArena::descriptor(size_t index) const
+{
+    return &descriptors[index];
+}
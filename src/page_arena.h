@@ -0,0 +1,59 @@
+/*
+  Page Frame Arena for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Pre-allocated memory for page cache frames and their descriptors,
+  so that cache fills and evictions never touch the heap.
+*/
+
+#ifndef PAGE_ARENA_H
+#define PAGE_ARENA_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+
+// Common type definitions
+#include "serverless_types.h"
+
+struct CachedPage;
+
+/**
+ * Page Frame Arena
+ *
+ * One anonymous mapping holds every 16KB page frame back to back
+ * (so each frame is 4KB aligned), optionally backed by 2MB huge
+ * pages. Descriptor i is permanently bound to frame i; the page
+ * cache recycles the pair as a unit on eviction.
+ */
+class PageFrameArena {
+private:
+    char* frames;
+    size_t mapped_bytes;
+    size_t frame_count;
+    bool large_pages;
+    CachedPage* descriptors;
+
+    PageFrameArena(const PageFrameArena&);
+    PageFrameArena& operator=(const PageFrameArena&);
+
+public:
+    PageFrameArena();
+    ~PageFrameArena();
+
+    // Map frame_count frames; returns false if memory is unavailable
+    bool allocate(size_t count, bool use_large_pages);
+    void release();
+
+    CachedPage* descriptor(size_t index) const;
+    size_t size() const { return frame_count; }
+    size_t bytes() const { return mapped_bytes; }
+    bool uses_large_pages() const { return large_pages; }
+};
+
+#endif /* PAGE_ARENA_H */
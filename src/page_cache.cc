@@ -0,0 +1,506 @@
+/*
+  Shared Page Cache Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Process-wide buffer pool shared by all serverless handlers
+*/
+
+#include "page_cache.h"
+#include "local_file_cache.h"
+#include <cstdlib>
+#include <cstring>
+
+// Global page cache instance
+std::unique_ptr<PageCache> global_page_cache;
+
+PageCache::PageCache(size_t capacity_bytes, size_t shard_count,
+                     PageCachePolicy replacement_policy, bool large_pages)
+    : capacity_pages(capacity_bytes / MARIADB_PAGE_SIZE), shard_mask(0),
+      policy(replacement_policy), use_large_pages(large_pages), second_tier(nullptr)
+{
+    // Always keep room for at least one page
+    if (capacity_pages == 0) {
+        capacity_pages = 1;
+    }
+
+    // Round the shard count down to a power of two, and never give
+    // a shard less than one page
+    size_t count = 1;
+    while (count * 2 <= shard_count && count * 2 <= capacity_pages) {
+        count *= 2;
+    }
+    shard_mask = count - 1;
+
+    shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::unique_ptr<PageCacheShard> shard(new PageCacheShard());
+        // Spread any remainder over the first shards
+        shard->capacity_pages = capacity_pages / count + (i < capacity_pages % count ? 1 : 0);
+        // 2Q tuning from the original paper: Kin = 25%, Kout = 50%
+        shard->probation_capacity = shard->capacity_pages / 4 > 0 ? shard->capacity_pages / 4 : 1;
+        shard->ghost_capacity = shard->capacity_pages / 2 > 0 ? shard->capacity_pages / 2 : 1;
+        shard->page_map.reserve(shard->capacity_pages);
+        shards.push_back(std::move(shard));
+    }
+}
+
+PageCache::~PageCache()
+{
+    // Descriptors and frames are owned by the arena
+    for (auto& shard : shards) {
+        shard->page_map.clear();
+    }
+}
+
+bool PageCache::initialize()
+{
+    if (!arena.allocate(capacity_pages, use_large_pages)) {
+        return false;
+    }
+
+    // Hand every shard a contiguous slice of descriptors
+    size_t next = 0;
+    for (auto& shard : shards) {
+        for (size_t i = 0; i < shard->capacity_pages; ++i) {
+            CachedPage* page = arena.descriptor(next++);
+            page->on_free_list = true;
+            shard->free_list.push_back(page);
+        }
+    }
+
+    return true;
+}
+
+PageCacheShard& PageCache::shard_for(const PageKey& key) const
+{
+    // Use the high bits so the shard choice is independent of the
+    // bucket the shard's own hash map picks
+    uint64_t h = PageKeyHash()(key);
+    return *shards[(h >> 32) & shard_mask];
+}
+
+PinResult PageCache::pin(const PageId& page_id, PageHandle* handle, uint64_t read_lsn,
+                         bool scan)
+{
+    PageKey key(page_id);
+    PageCacheShard& shard = shard_for(key);
+
+    std::unique_lock<std::mutex> lock(shard.latch);
+
+    for (;;) {
+        auto it = shard.page_map.find(key);
+        if (it == shard.page_map.end()) {
+            break;
+        }
+
+        CachedPage* page = it->second;
+        if (page->lsn < read_lsn) {
+            // Read (or being read) before writes we must see
+            shard.stale_reads++;
+            retire_page(shard, page);
+            break;
+        }
+
+        page->pin_count++;
+        if (!scan) {
+            page->scan_fill = false;
+        }
+        page->reused = true;
+        // Probation is a FIFO: correlated re-references do not promote
+        if (page->segment == PAGE_SEGMENT_MAIN) {
+            shard.lru_list.move_to_front(page);
+        }
+
+        if (page->io_pending) {
+            // Someone is already reading this page: wait for that read
+            shard.coalesced_reads++;
+            shard.io_done.wait(lock, [page] { return !page->io_pending; });
+
+            if (!page->published) {
+                // The read failed or the page was invalidated or went
+                // stale; our pin may be the last one keeping the frame
+                // off the free list
+                if (--page->pin_count == 0) {
+                    free_page(shard, page);
+                }
+                continue;
+            }
+        }
+
+        shard.hits++;
+        lock.unlock();
+
+        handle->attach(this, page, false);
+        return PIN_HIT;
+    }
+
+    shard.misses++;
+    SpilledPage spill;
+    CachedPage* page = claim_frame(shard, page_id, read_lsn, scan, &spill);
+    if (!page) {
+        return PIN_NO_FRAME;
+    }
+    lock.unlock();
+
+    handle->attach(this, page, true);
+    if (fill_from_second_tier(handle, read_lsn, spill)) {
+        return PIN_HIT;
+    }
+    return PIN_MISS;
+}
+
+bool PageCache::reserve(const PageId& page_id, PageHandle* handle, uint64_t read_lsn,
+                        bool scan)
+{
+    PageKey key(page_id);
+    PageCacheShard& shard = shard_for(key);
+
+    std::unique_lock<std::mutex> lock(shard.latch);
+
+    auto it = shard.page_map.find(key);
+    if (it != shard.page_map.end()) {
+        if (it->second->lsn >= read_lsn) {
+            return false;
+        }
+        shard.stale_reads++;
+        retire_page(shard, it->second);
+    }
+
+    SpilledPage spill;
+    CachedPage* page = claim_frame(shard, page_id, read_lsn, scan, &spill);
+    if (!page) {
+        return false;
+    }
+    lock.unlock();
+
+    handle->attach(this, page, true);
+    if (fill_from_second_tier(handle, read_lsn, spill)) {
+        handle->release();
+        return false;
+    }
+    return true;
+}
+
+bool PageCache::fill_from_second_tier(PageHandle* handle, uint64_t read_lsn,
+                                      const SpilledPage& spill)
+{
+    if (!second_tier) {
+        return false;
+    }
+
+    // Save the evicted image before the frame is overwritten
+    if (spill.valid) {
+        second_tier->write(spill.page_id, handle->page->data, spill.lsn, spill.reused,
+                           spill.generation);
+    }
+
+    uint64_t lsn;
+    if (!second_tier->read(handle->page_id(), handle->frame(), read_lsn, &lsn)) {
+        return false;
+    }
+
+    publish(handle, lsn);
+    return true;
+}
+
+CachedPage* PageCache::claim_frame(PageCacheShard& shard, const PageId& page_id,
+                                   uint64_t read_lsn, bool scan, SpilledPage* spill)
+{
+    if (!shard.free_list.head && !evict_page(shard, spill)) {
+        return nullptr;
+    }
+
+    CachedPage* page = shard.free_list.head;
+    shard.free_list.remove(page);
+    page->on_free_list = false;
+    page->reset(page_id);
+    page->pin_count = 1;
+
+    // Visible immediately so concurrent readers wait on this read;
+    // those needing a newer LSN than it targets replace it instead
+    page->lsn = read_lsn;
+    page->io_pending = true;
+    link_page(shard, page, scan);
+    shard.page_map[PageKey(page_id)] = page;
+    page->published = true;
+
+    return page;
+}
+
+void PageCache::link_page(PageCacheShard& shard, CachedPage* page, bool scan)
+{
+    PageKey key(page->page_id);
+    page->scan_fill = scan;
+
+    if (policy == PAGE_CACHE_POLICY_2Q) {
+        auto ghost = shard.ghost_keys.find(key);
+        if (ghost != shard.ghost_keys.end() && !scan) {
+            // Re-referenced after leaving probation: admit to main LRU
+            shard.ghost_keys.erase(ghost);
+            page->segment = PAGE_SEGMENT_MAIN;
+            shard.lru_list.push_front(page);
+        } else {
+            page->segment = PAGE_SEGMENT_PROBATION;
+            shard.probation_list.push_front(page);
+        }
+    } else if (scan) {
+        // Scanned pages go to the cold end and are replaced first
+        shard.lru_list.push_back(page);
+    } else {
+        shard.lru_list.push_front(page);
+    }
+}
+
+void PageCache::publish(PageHandle* handle, uint64_t lsn)
+{
+    CachedPage* page = handle->page;
+    PageCacheShard& shard = shard_for(PageKey(page->page_id));
+
+    {
+        std::lock_guard<std::mutex> lock(shard.latch);
+        page->lsn = lsn;
+        page->io_pending = false;
+    }
+    handle->filling = false;
+    shard.io_done.notify_all();
+}
+
+void PageHandle::release()
+{
+    if (page) {
+        if (filling) {
+            cache->abandon_fill(page);
+        } else {
+            cache->unpin(page);
+        }
+        page = nullptr;
+        cache = nullptr;
+        filling = false;
+    }
+}
+
+void PageCache::abandon_fill(CachedPage* page)
+{
+    PageCacheShard& shard = shard_for(PageKey(page->page_id));
+
+    {
+        std::lock_guard<std::mutex> lock(shard.latch);
+
+        // Unless already invalidated, withdraw the never-filled page
+        if (page->published) {
+            unlink_page(shard, page);
+            shard.page_map.erase(PageKey(page->page_id));
+            page->published = false;
+        }
+        page->io_pending = false;
+
+        // Waiters hold their own pins and free the frame if they are last
+        if (--page->pin_count == 0) {
+            free_page(shard, page);
+        }
+    }
+    shard.io_done.notify_all();
+}
+
+void PageCache::unpin(CachedPage* page)
+{
+    // Fast path: a published page just drops its pin. The last pin on
+    // a page that was invalidated while pinned hands the descriptor
+    // back to the free list.
+    if (page->pin_count.fetch_sub(1) != 1 || page->published) {
+        return;
+    }
+
+    PageCacheShard& shard = shard_for(PageKey(page->page_id));
+    std::lock_guard<std::mutex> lock(shard.latch);
+    if (page->pin_count == 0 && !page->published) {
+        free_page(shard, page);
+    }
+}
+
+// Least recently used page of a list that nobody has pinned
+static CachedPage* unpinned_tail(const PageList& list)
+{
+    for (CachedPage* page = list.tail; page; page = page->lru_prev) {
+        if (page->pin_count == 0) {
+            return page;
+        }
+    }
+    return nullptr;
+}
+
+bool PageCache::evict_page(PageCacheShard& shard, SpilledPage* spill)
+{
+    CachedPage* victim = nullptr;
+    if (shard.probation_list.length > shard.probation_capacity || !shard.lru_list.tail) {
+        victim = unpinned_tail(shard.probation_list);
+    }
+    if (!victim) {
+        victim = unpinned_tail(shard.lru_list);
+    }
+    if (!victim) {
+        victim = unpinned_tail(shard.probation_list);
+    }
+    if (!victim) {
+        return false;
+    }
+
+    // Scan-only pages leave no trace, so scans never earn promotion
+    if (victim->segment == PAGE_SEGMENT_PROBATION && !victim->scan_fill) {
+        remember_ghost(shard, PageKey(victim->page_id));
+    }
+
+    // The victim is clean (all writes go through the WAL), so the
+    // second tier can take it once the claimer has dropped the latch
+    if (second_tier) {
+        spill->page_id = victim->page_id;
+        spill->lsn = victim->lsn;
+        spill->generation = second_tier->generation();
+        spill->reused = victim->reused;
+        spill->valid = true;
+    }
+
+    unlink_page(shard, victim);
+    shard.page_map.erase(PageKey(victim->page_id));
+    victim->published = false;
+    free_page(shard, victim);
+    shard.evictions++;
+    return true;
+}
+
+void PageCache::unlink_page(PageCacheShard& shard, CachedPage* page)
+{
+    if (page->segment == PAGE_SEGMENT_PROBATION) {
+        shard.probation_list.remove(page);
+    } else {
+        shard.lru_list.remove(page);
+    }
+}
+
+void PageCache::retire_page(PageCacheShard& shard, CachedPage* page)
+{
+    unlink_page(shard, page);
+    shard.page_map.erase(PageKey(page->page_id));
+    page->published = false;
+    // A pinned page is recycled by its last unpin; waiters on a pending
+    // read find it unpublished and look the page up again
+    if (page->pin_count == 0) {
+        free_page(shard, page);
+    }
+}
+
+void PageCache::free_page(PageCacheShard& shard, CachedPage* page)
+{
+    if (!page->on_free_list) {
+        page->on_free_list = true;
+        shard.free_list.push_front(page);
+    }
+}
+
+void PageCache::remember_ghost(PageCacheShard& shard, const PageKey& key)
+{
+    uint64_t sequence = ++shard.ghost_sequence;
+    shard.ghost_keys[key] = sequence;
+    shard.ghost_fifo.push_back(std::make_pair(key, sequence));
+
+    // Trim the oldest ghosts. Every live key has its latest entry in
+    // the queue, so bounding the queue bounds the key set; entries
+    // superseded by a newer ghost or consumed by an admission are
+    // simply dropped.
+    while (shard.ghost_fifo.size() > shard.ghost_capacity) {
+        std::pair<PageKey, uint64_t> oldest = shard.ghost_fifo.front();
+        shard.ghost_fifo.pop_front();
+
+        auto it = shard.ghost_keys.find(oldest.first);
+        if (it != shard.ghost_keys.end() && it->second == oldest.second) {
+            shard.ghost_keys.erase(it);
+        }
+    }
+}
+
+void PageCache::invalidate_timeline(const TimelineId& timeline_id)
+{
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->latch);
+
+        auto it = shard->page_map.begin();
+        while (it != shard->page_map.end()) {
+            if (it->first.timeline_id == timeline_id.id) {
+                CachedPage* page = it->second;
+                unlink_page(*shard, page);
+                page->published = false;
+                // A pinned page is recycled by its last unpin
+                if (page->pin_count == 0) {
+                    free_page(*shard, page);
+                }
+                it = shard->page_map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (second_tier) {
+        second_tier->invalidate_timeline(timeline_id);
+    }
+}
+
+void PageCache::collect_hot_pages(std::vector<PageId>* pages, size_t limit) const
+{
+    size_t per_shard = (limit + shards.size() - 1) / shards.size();
+
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->latch);
+
+        // Main LRU first, then probation; scan fills are not worth keeping
+        size_t taken = 0;
+        for (CachedPage* page = shard->lru_list.head;
+             page && taken < per_shard; page = page->lru_next) {
+            if (!page->io_pending && !page->scan_fill) {
+                pages->push_back(page->page_id);
+                taken++;
+            }
+        }
+        for (CachedPage* page = shard->probation_list.head;
+             page && taken < per_shard; page = page->lru_next) {
+            if (!page->io_pending && !page->scan_fill) {
+                pages->push_back(page->page_id);
+                taken++;
+            }
+        }
+    }
+
+    if (pages->size() > limit) {
+        pages->erase(pages->begin() + limit, pages->end());
+    }
+}
+
+PageCache::CacheStats PageCache::get_stats() const
+{
+    CacheStats stats;
+    stats.capacity_pages = capacity_pages;
+    stats.shard_count = shards.size();
+    stats.cached_pages = 0;
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.evictions = 0;
+    stats.coalesced_reads = 0;
+    stats.stale_reads = 0;
+
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->latch);
+        stats.cached_pages += shard->page_map.size();
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.evictions += shard->evictions;
+        stats.coalesced_reads += shard->coalesced_reads;
+        stats.stale_reads += shard->stale_reads;
+    }
+
+    stats.hit_rate = (stats.hits + stats.misses) > 0 ?
+        static_cast<double>(stats.hits) / (stats.hits + stats.misses) : 1.0;
+    stats.arena_bytes = arena.bytes();
+    stats.large_pages = arena.uses_large_pages();
+
+    return stats;
+}
@@ -0,0 +1,396 @@
+/*
+  Shared Page Cache for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Process-wide buffer pool holding page images fetched from the
+  pageserver. A single instance is shared by every ha_serverless
+  handler, so memory use follows the working set rather than the
+  number of open tables.
+*/
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+#include "page_arena.h"
+
+/**
+ * Cache key: a page within a timeline
+ */
+struct PageKey {
+    uint64_t timeline_id;
+    uint32_t page_number;
+
+    PageKey(const PageId& id)
+        : timeline_id(id.timeline_id), page_number(id.page_number) {}
+
+    bool operator==(const PageKey& other) const {
+        return timeline_id == other.timeline_id && page_number == other.page_number;
+    }
+};
+
+struct PageKeyHash {
+    size_t operator()(const PageKey& key) const {
+        // Timeline ids are already string hashes; mix in the page number
+        uint64_t h = key.timeline_id ^ (key.page_number * 0x9e3779b97f4a7c15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return (size_t)h;
+    }
+};
+
+// Replacement policies (serverless_page_cache_policy)
+enum PageCachePolicy {
+    PAGE_CACHE_POLICY_LRU = 0,  // Plain LRU
+    PAGE_CACHE_POLICY_2Q = 1    // Probationary FIFO + ghost keys + main LRU
+};
+
+// Replacement list a cached page currently lives on
+enum PageSegment {
+    PAGE_SEGMENT_MAIN = 0,
+    PAGE_SEGMENT_PROBATION = 1
+};
+
+// Page cache entry
+struct CachedPage {
+    PageId page_id;
+    char* data;             // 16KB frame in the page arena
+    uint64_t lsn;           // LSN the image is valid at (target LSN while io_pending)
+    PageSegment segment;    // Replacement list holding the page
+    bool scan_fill;         // Only referenced by sequential scans so far
+    bool reused;            // Hit at least once since it was read
+
+    // Readers holding a PageHandle; pinned pages are never evicted.
+    // Pins are taken under the shard latch and dropped without it.
+    std::atomic<uint32_t> pin_count;
+    std::atomic<bool> published;    // Reachable through the page map
+    bool io_pending;                // Being read by its first reader
+    bool on_free_list;              // Protected by the shard latch
+
+    // Replacement list links (owned by the shard)
+    CachedPage* lru_prev;
+    CachedPage* lru_next;
+
+    CachedPage()
+        : page_id(0, 0), data(nullptr), lsn(0), segment(PAGE_SEGMENT_MAIN),
+          scan_fill(false), reused(false), pin_count(0), published(false), io_pending(false),
+          on_free_list(false), lru_prev(nullptr), lru_next(nullptr) {}
+
+    // Rebind a recycled descriptor (and its frame) to a new page
+    void reset(const PageId& id) {
+        page_id = id;
+        lsn = 0;
+        segment = PAGE_SEGMENT_MAIN;
+        scan_fill = false;
+        reused = false;
+        published = false;
+        io_pending = false;
+    }
+};
+
+// Outcome of PageCache::pin()
+enum PinResult {
+    PIN_HIT = 0,        // Handle pins a valid cached page
+    PIN_MISS = 1,       // Handle pins a reserved frame the caller must fill
+    PIN_NO_FRAME = 2    // Page absent and every frame is pinned
+};
+
+class PageCache;
+class LocalFileCache;
+
+/**
+ * Pinned reference to a cache frame
+ *
+ * Readers decode rows straight out of the frame instead of copying
+ * the page. The page cannot be evicted or recycled until the handle
+ * is released or destroyed.
+ */
+class PageHandle {
+private:
+    PageCache* cache;
+    CachedPage* page;
+    bool filling;           // Holds a reserved frame not yet published
+
+    friend class PageCache;
+    void attach(PageCache* owner, CachedPage* pinned, bool fill) {
+        release();
+        cache = owner;
+        page = pinned;
+        filling = fill;
+    }
+
+public:
+    PageHandle() : cache(nullptr), page(nullptr), filling(false) {}
+    ~PageHandle() { release(); }
+
+    PageHandle(PageHandle&& other) noexcept
+        : cache(other.cache), page(other.page), filling(other.filling) {
+        other.cache = nullptr;
+        other.page = nullptr;
+        other.filling = false;
+    }
+
+    PageHandle& operator=(PageHandle&& other) noexcept {
+        if (this != &other) {
+            release();
+            cache = other.cache;
+            page = other.page;
+            filling = other.filling;
+            other.cache = nullptr;
+            other.page = nullptr;
+            other.filling = false;
+        }
+        return *this;
+    }
+
+    // Delete copy constructor
+    PageHandle(const PageHandle&) = delete;
+    PageHandle& operator=(const PageHandle&) = delete;
+
+    bool valid() const { return page != nullptr; }
+    const char* data() const { return page->data; }
+    uint64_t lsn() const { return page->lsn; }
+    const PageId& page_id() const { return page->page_id; }
+
+    // Writable frame; only for filling a reserved page before publish()
+    char* frame() { return page->data; }
+
+    // Releasing a reserved frame before publish() abandons the read
+    // and wakes any readers waiting for it
+    void release();
+};
+
+/**
+ * Intrusive doubly-linked replacement list
+ *
+ * Links live in CachedPage itself, so insertion, promotion and
+ * removal are O(1) and need no per-node allocation.
+ */
+struct PageList {
+    CachedPage* head;       // Most recently used
+    CachedPage* tail;       // Least recently used
+    size_t length;
+
+    PageList() : head(nullptr), tail(nullptr), length(0) {}
+
+    void push_front(CachedPage* page) {
+        page->lru_prev = nullptr;
+        page->lru_next = head;
+        if (head) {
+            head->lru_prev = page;
+        } else {
+            tail = page;
+        }
+        head = page;
+        length++;
+    }
+
+    void push_back(CachedPage* page) {
+        page->lru_next = nullptr;
+        page->lru_prev = tail;
+        if (tail) {
+            tail->lru_next = page;
+        } else {
+            head = page;
+        }
+        tail = page;
+        length++;
+    }
+
+    void remove(CachedPage* page) {
+        if (page->lru_prev) {
+            page->lru_prev->lru_next = page->lru_next;
+        } else {
+            head = page->lru_next;
+        }
+        if (page->lru_next) {
+            page->lru_next->lru_prev = page->lru_prev;
+        } else {
+            tail = page->lru_prev;
+        }
+        page->lru_prev = page->lru_next = nullptr;
+        length--;
+    }
+
+    void move_to_front(CachedPage* page) {
+        if (head != page) {
+            remove(page);
+            push_front(page);
+        }
+    }
+};
+
+/**
+ * One hash partition of the page cache
+ *
+ * Every shard has its own latch, map and replacement lists, so
+ * lookups of pages that hash to different shards never contend.
+ *
+ * Under the 2Q policy new pages enter probation_list (a FIFO whose
+ * hits are not promoted). Pages evicted from probation leave their
+ * key in the ghost queue; a miss on a ghost key proves reuse and the
+ * page is admitted straight into lru_list. Pages filled by scans
+ * leave no ghost, so a full table scan cannot displace the hot set.
+ */
+struct PageCacheShard {
+    std::mutex latch;
+    std::condition_variable io_done;    // Signalled when a read finishes
+    std::unordered_map<PageKey, CachedPage*, PageKeyHash> page_map;
+    PageList lru_list;              // Main LRU (2Q: Am)
+    PageList probation_list;        // 2Q: A1in
+    PageList free_list;             // Unused descriptors of this shard
+    size_t capacity_pages;
+    size_t probation_capacity;
+
+    // 2Q ghost keys (A1out): key -> sequence of its ghost_fifo entry
+    std::unordered_map<PageKey, uint64_t, PageKeyHash> ghost_keys;
+    std::deque<std::pair<PageKey, uint64_t>> ghost_fifo;
+    size_t ghost_capacity;
+    uint64_t ghost_sequence;
+
+    // Statistics (protected by latch)
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t coalesced_reads;           // Misses that waited on another read
+    uint64_t stale_reads;               // Entries found older than the read LSN
+
+    PageCacheShard()
+        : capacity_pages(0), probation_capacity(0), ghost_capacity(0),
+          ghost_sequence(0), hits(0), misses(0), evictions(0), coalesced_reads(0),
+          stale_reads(0) {}
+};
+
+/**
+ * Page Cache
+ *
+ * Engine-wide cache of pageserver pages, bounded by a byte budget.
+ * Entries are keyed by (timeline, page) and tagged with the LSN they
+ * were read at. The cache is split into a power of two number of
+ * shards selected by the page key hash, and uses either plain LRU or
+ * scan-resistant 2Q replacement.
+ *
+ * Lookups name the LSN the caller must observe (normally the last
+ * LSN written to the timeline). An entry read at an older LSN may
+ * predate those writes, so it is dropped and the page is read again
+ * at the requested LSN. Only the newest image of a page is kept.
+ */
+class PageCache {
+private:
+    size_t capacity_pages;
+    size_t shard_mask;
+    PageCachePolicy policy;
+    bool use_large_pages;
+    std::vector<std::unique_ptr<PageCacheShard>> shards;
+
+    // Backing memory for every frame and descriptor
+    PageFrameArena arena;
+
+    // Optional disk tier receiving evicted pages (not owned)
+    LocalFileCache* second_tier;
+
+    // Page pushed out by claim_frame(); its image stays in the claimed
+    // frame until the claimer has offered it to the second tier
+    struct SpilledPage {
+        PageId page_id;
+        uint64_t lsn;
+        uint64_t generation;    // Second tier invalidation generation
+        bool reused;
+        bool valid;
+
+        SpilledPage() : page_id(0, 0), lsn(0), generation(0), reused(false), valid(false) {}
+    };
+
+    friend class PageHandle;
+
+    PageCacheShard& shard_for(const PageKey& key) const;
+    bool evict_page(PageCacheShard& shard, SpilledPage* spill);
+    void unlink_page(PageCacheShard& shard, CachedPage* page);
+    void retire_page(PageCacheShard& shard, CachedPage* page);
+    void free_page(PageCacheShard& shard, CachedPage* page);
+    void remember_ghost(PageCacheShard& shard, const PageKey& key);
+    void link_page(PageCacheShard& shard, CachedPage* page, bool scan);
+    CachedPage* claim_frame(PageCacheShard& shard, const PageId& page_id, uint64_t read_lsn,
+                            bool scan, SpilledPage* spill);
+    bool fill_from_second_tier(PageHandle* handle, uint64_t read_lsn, const SpilledPage& spill);
+    void unpin(CachedPage* page);
+    void abandon_fill(CachedPage* page);
+
+public:
+    PageCache(size_t capacity_bytes, size_t shard_count,
+              PageCachePolicy replacement_policy = PAGE_CACHE_POLICY_LRU,
+              bool large_pages = false);
+    ~PageCache();
+
+    // Allocate the frame arena; must succeed before any other call
+    bool initialize();
+
+    // Spill evicted pages to, and serve misses from, a disk tier
+    void set_second_tier(LocalFileCache* tier) { second_tier = tier; }
+
+    // Pin the image of a page valid at read_lsn or later. On PIN_MISS
+    // the handle holds a frame reserved for the page: the caller reads
+    // the page as of read_lsn into it and calls publish(). Concurrent
+    // readers of the same page wait for that single read instead of
+    // issuing their own. scan marks references made by sequential
+    // table scans.
+    PinResult pin(const PageId& page_id, PageHandle* handle, uint64_t read_lsn,
+                  bool scan = false);
+
+    // Reserve a frame for a page nobody has cached at read_lsn or is
+    // reading (used for prefetching); returns false otherwise,
+    // including when the page could be loaded from the second tier
+    bool reserve(const PageId& page_id, PageHandle* handle, uint64_t read_lsn,
+                 bool scan = false);
+
+    // Complete the read of a reserved frame and wake its waiters; lsn
+    // is the LSN the image was read at
+    void publish(PageHandle* handle, uint64_t lsn);
+
+    // Drop every cached page belonging to a timeline
+    void invalidate_timeline(const TimelineId& timeline_id);
+
+    // Collect up to limit pages worth keeping across a restart, taking
+    // the most recently used of every shard; scan-only pages are skipped
+    void collect_hot_pages(std::vector<PageId>* pages, size_t limit) const;
+
+    // Statistics and monitoring
+    struct CacheStats {
+        size_t capacity_pages;
+        size_t shard_count;
+        size_t cached_pages;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t coalesced_reads;
+        uint64_t stale_reads;
+        double hit_rate;
+        size_t arena_bytes;
+        bool large_pages;
+    };
+
+    CacheStats get_stats() const;
+};
+
+// Global page cache instance
+extern std::unique_ptr<PageCache> global_page_cache;
+
+#endif /* PAGE_CACHE_H */
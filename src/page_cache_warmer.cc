@@ -0,0 +1,248 @@
+/*
+  Page Cache Warm-up Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Hot page list dump and asynchronous reload for the page cache
+*/
+
+#include "page_cache_warmer.h"
+#include "page_cache.h"
+#include "connection_pool.h"
+#include "pageserver_shard_map.h"
+#include <mysql/plugin.h>
+#include <sql_class.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Global warmer instance
+std::unique_ptr<PageCacheWarmer> global_page_cache_warmer;
+
+PageCacheWarmer::PageCacheWarmer(const char* path, std::chrono::seconds interval,
+                                 bool load, size_t dump_limit, size_t load_batch)
+    : dump_path(strdup(path)), dump_interval(interval), load_at_startup(load),
+      max_pages(dump_limit), batch_size(load_batch), shutdown_requested(false)
+{
+}
+
+PageCacheWarmer::~PageCacheWarmer()
+{
+    stop();
+    free(dump_path);
+}
+
+void PageCacheWarmer::start()
+{
+    worker_thread = std::thread(&PageCacheWarmer::worker_thread_main, this);
+}
+
+void PageCacheWarmer::stop()
+{
+    if (!worker_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        shutdown_requested = true;
+    }
+    worker_condition.notify_all();
+    worker_thread.join();
+
+    // Final dump so the next start sees the latest working set
+    dump();
+}
+
+bool PageCacheWarmer::stopping()
+{
+    std::lock_guard<std::mutex> lock(worker_mutex);
+    return shutdown_requested;
+}
+
+void PageCacheWarmer::worker_thread_main()
+{
+    if (load_at_startup) {
+        std::vector<PageId> pages;
+        if (read_dump(&pages)) {
+            sql_print_information("ServerlessDB: Loading %zu pages from %s", pages.size(), dump_path);
+            load_pages(pages);
+            sql_print_information("ServerlessDB: Page cache warm-up loaded %llu pages",
+                                  (unsigned long long)pages_loaded.load());
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(worker_mutex);
+    while (!shutdown_requested) {
+        if (dump_interval.count() == 0) {
+            worker_condition.wait(lock, [this] { return shutdown_requested; });
+            break;
+        }
+
+        if (worker_condition.wait_for(lock, dump_interval, [this] { return shutdown_requested; })) {
+            break;
+        }
+
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
+
+bool PageCacheWarmer::read_dump(std::vector<PageId>* pages)
+{
+    FILE* file = fopen(dump_path, "r");
+    if (!file) {
+        return false;
+    }
+
+    unsigned long long timeline_id;
+    unsigned int page_number;
+    while (pages->size() < max_pages &&
+           fscanf(file, "%llu,%u\n", &timeline_id, &page_number) == 2) {
+        pages->push_back(PageId(timeline_id, page_number));
+    }
+
+    fclose(file);
+    return true;
+}
+
+void PageCacheWarmer::load_pages(const std::vector<PageId>& pages)
+{
+    // Latest LSN of every timeline seen so far; pages are read at it so
+    // handlers opening the table at that LSN can use them
+    std::unordered_map<uint64_t, uint64_t> timeline_lsns;
+
+    for (size_t offset = 0; offset < pages.size(); offset += batch_size) {
+        if (stopping() || !global_page_cache || !global_connection_pool) {
+            return;
+        }
+
+        size_t count = pages.size() - offset < batch_size ? pages.size() - offset : batch_size;
+        if (prefetch_batch(&pages[offset], count, &timeline_lsns) < 0) {
+            sql_print_warning("ServerlessDB: Page cache warm-up stopped, pageserver unavailable");
+            return;
+        }
+    }
+}
+
+int PageCacheWarmer::prefetch_batch(const PageId* pages, size_t count,
+                                    std::unordered_map<uint64_t, uint64_t>* timeline_lsns)
+{
+    // Group the batch by timeline and pageserver shard so each group
+    // is a single request
+    const PageserverShardMap* shards = global_pageserver_shards.get();
+    std::vector<PageId> sorted(pages, pages + count);
+    std::stable_sort(sorted.begin(), sorted.end(), [shards](const PageId& a, const PageId& b) {
+        if (a.timeline_id != b.timeline_id) {
+            return a.timeline_id < b.timeline_id;
+        }
+        return shards->shard_for(a) < shards->shard_for(b);
+    });
+
+    std::vector<PageHandle> handles;
+    std::vector<uint32_t> page_numbers;
+    std::vector<char*> frames;
+    handles.reserve(count);
+    page_numbers.reserve(count);
+    frames.reserve(count);
+
+    int loaded = 0;
+    size_t group_end;
+    for (size_t group = 0; group < sorted.size(); group = group_end) {
+        uint64_t timeline_id = sorted[group].timeline_id;
+        size_t shard = shards->shard_for(sorted[group]);
+        group_end = group + 1;
+        while (group_end < sorted.size() && sorted[group_end].timeline_id == timeline_id &&
+               shards->shard_for(sorted[group_end]) == shard) {
+            group_end++;
+        }
+
+        PageserverClient* client = global_connection_pool->get_pageserver_connection(shard);
+        if (!client) {
+            return -1;
+        }
+
+        PooledPageserverConnection pooled_client(client, global_connection_pool.get());
+
+        auto it = timeline_lsns->find(timeline_id);
+        if (it == timeline_lsns->end()) {
+            // Zero marks a timeline the pageserver no longer knows
+            uint64_t latest_lsn;
+            if (pooled_client->get_timeline_info(TimelineId(timeline_id), &latest_lsn) != 0) {
+                latest_lsn = 0;
+            }
+            it = timeline_lsns->insert(std::make_pair(timeline_id, latest_lsn)).first;
+        }
+        if (it->second == 0) {
+            continue;
+        }
+
+        // Pages already cached or being read by a query are skipped
+        handles.clear();
+        page_numbers.clear();
+        frames.clear();
+        for (size_t i = group; i < group_end; ++i) {
+            handles.emplace_back();
+            if (!global_page_cache->reserve(sorted[i], &handles.back(), it->second)) {
+                handles.pop_back();
+                continue;
+            }
+            page_numbers.push_back(sorted[i].page_number);
+            frames.push_back(handles.back().frame());
+        }
+        if (handles.empty()) {
+            continue;
+        }
+
+        // On failure the handles abandon their reserved frames
+        if (pooled_client->read_pages(TimelineId(timeline_id), page_numbers.data(),
+                                      frames.data(), frames.size(), it->second) == 0) {
+            for (PageHandle& handle : handles) {
+                global_page_cache->publish(&handle, it->second);
+            }
+            loaded += handles.size();
+        }
+        handles.clear();
+    }
+
+    pages_loaded += loaded;
+    return loaded;
+}
+
+bool PageCacheWarmer::dump()
+{
+    if (!global_page_cache) {
+        return false;
+    }
+
+    std::vector<PageId> pages;
+    pages.reserve(max_pages);
+    global_page_cache->collect_hot_pages(&pages, max_pages);
+
+    // Write a temporary file and rename it so a crash never leaves a
+    // truncated dump behind
+    char temp_path[FN_REFLEN];
+    snprintf(temp_path, sizeof(temp_path), "%s.incomplete", dump_path);
+
+    FILE* file = fopen(temp_path, "w");
+    if (!file) {
+        sql_print_warning("ServerlessDB: Cannot write page cache dump %s", temp_path);
+        return false;
+    }
+
+    for (const PageId& page : pages) {
+        fprintf(file, "%llu,%u\n", (unsigned long long)page.timeline_id, page.page_number);
+    }
+
+    bool ok = fflush(file) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, dump_path) != 0) {
+        sql_print_warning("ServerlessDB: Failed to write page cache dump %s", dump_path);
+        remove(temp_path);
+        return false;
+    }
+
+    pages_dumped = pages.size();
+    return true;
+}
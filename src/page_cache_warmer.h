@@ -0,0 +1,83 @@
+/*
+  Page Cache Warm-up for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Persists the list of hot pages across restarts and prefetches them
+  from the pageserver in the background when the engine starts, in
+  the spirit of InnoDB's buffer pool dump/load.
+*/
+
+#ifndef PAGE_CACHE_WARMER_H
+#define PAGE_CACHE_WARMER_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+
+/**
+ * Page Cache Warmer
+ *
+ * One background thread first reloads the pages listed in the dump
+ * file (if requested), then rewrites the file at a fixed interval.
+ * A final dump is taken when the warmer is stopped.
+ */
+class PageCacheWarmer {
+private:
+    char* dump_path;
+    std::chrono::seconds dump_interval;     // Zero: dump at shutdown only
+    bool load_at_startup;
+    size_t max_pages;
+    size_t batch_size;
+
+    std::thread worker_thread;
+    std::mutex worker_mutex;
+    std::condition_variable worker_condition;
+    bool shutdown_requested;
+
+    // Statistics
+    std::atomic<uint64_t> pages_loaded{0};
+    std::atomic<uint64_t> pages_dumped{0};
+
+    void worker_thread_main();
+    bool read_dump(std::vector<PageId>* pages);
+    void load_pages(const std::vector<PageId>& pages);
+    int prefetch_batch(const PageId* pages, size_t count,
+                       std::unordered_map<uint64_t, uint64_t>* timeline_lsns);
+
+    bool stopping();
+
+public:
+    PageCacheWarmer(const char* path, std::chrono::seconds interval,
+                    bool load, size_t dump_limit, size_t load_batch = 64);
+    ~PageCacheWarmer();
+
+    void start();
+    void stop();
+
+    // Write the current hot page list; returns false on I/O error
+    bool dump();
+
+    uint64_t get_pages_loaded() const { return pages_loaded.load(); }
+    uint64_t get_pages_dumped() const { return pages_dumped.load(); }
+};
+
+// Global warmer instance (null when dumping is disabled)
+extern std::unique_ptr<PageCacheWarmer> global_page_cache_warmer;
+
+#endif /* PAGE_CACHE_WARMER_H */
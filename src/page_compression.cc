@@ -0,0 +1,134 @@
+/*
+  Page Compression Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  LZ4 and zstd decoding of transferred page images
+*/
+
+#include "page_compression.h"
+#include <atomic>
+#include <cstring>
+#include <strings.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Statistics over all decompressors
+static std::atomic<uint64_t> decoded_pages{0};
+static std::atomic<uint64_t> decoded_compressed_bytes{0};
+static std::atomic<uint64_t> decoded_uncompressed_bytes{0};
+
+const char* page_compression_name(PageCompression codec)
+{
+    switch (codec) {
+    case PAGE_COMPRESSION_LZ4:
+        return "lz4";
+    case PAGE_COMPRESSION_ZSTD:
+        return "zstd";
+    default:
+        return nullptr;
+    }
+}
+
+PageCompression page_compression_from_name(const char* name, size_t length)
+{
+    if (length == 3 && strncasecmp(name, "lz4", 3) == 0) {
+        return PAGE_COMPRESSION_LZ4;
+    }
+    if (length == 4 && strncasecmp(name, "zstd", 4) == 0) {
+        return PAGE_COMPRESSION_ZSTD;
+    }
+    return PAGE_COMPRESSION_NONE;
+}
+
+bool page_compression_available(PageCompression codec)
+{
+    switch (codec) {
+    case PAGE_COMPRESSION_NONE:
+        return true;
+#ifdef HAVE_LZ4
+    case PAGE_COMPRESSION_LZ4:
+        return true;
+#endif
+#ifdef HAVE_ZSTD
+    case PAGE_COMPRESSION_ZSTD:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+PageDecompressor::PageDecompressor()
+    : zstd_context(nullptr)
+{
+}
+
+PageDecompressor::~PageDecompressor()
+{
+#ifdef HAVE_ZSTD
+    if (zstd_context) {
+        ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(zstd_context));
+    }
+#endif
+}
+
+int PageDecompressor::decompress(PageCompression codec, const char* source, size_t source_length,
+                                 char* frame, size_t frame_size)
+{
+    size_t decoded;
+
+    switch (codec) {
+#ifdef HAVE_LZ4
+    case PAGE_COMPRESSION_LZ4: {
+        int result = LZ4_decompress_safe(source, frame, (int)source_length, (int)frame_size);
+        if (result <= 0) {
+            return -1;
+        }
+        decoded = result;
+        break;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case PAGE_COMPRESSION_ZSTD: {
+        if (!zstd_context) {
+            zstd_context = ZSTD_createDCtx();
+            if (!zstd_context) {
+                return -1;
+            }
+        }
+        size_t result = ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(zstd_context),
+                                            frame, frame_size, source, source_length);
+        if (ZSTD_isError(result) || result == 0) {
+            return -1;
+        }
+        decoded = result;
+        break;
+    }
+#endif
+    default:
+        return -1;
+    }
+
+    if (decoded < frame_size) {
+        memset(frame + decoded, 0, frame_size - decoded);
+    }
+
+    decoded_pages++;
+    decoded_compressed_bytes += source_length;
+    decoded_uncompressed_bytes += decoded;
+    return 0;
+}
+
+PageCompressionStats get_page_compression_stats()
+{
+    PageCompressionStats stats;
+    stats.pages = decoded_pages.load();
+    stats.compressed_bytes = decoded_compressed_bytes.load();
+    stats.uncompressed_bytes = decoded_uncompressed_bytes.load();
+    return stats;
+}
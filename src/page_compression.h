@@ -0,0 +1,76 @@
+/*
+  Page Compression for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Decoding of page images the pageserver sends compressed. LZ4 favours
+  latency, zstd favours bandwidth; each codec is available when the
+  engine is built with its library (HAVE_LZ4, HAVE_ZSTD).
+*/
+
+#ifndef PAGE_COMPRESSION_H
+#define PAGE_COMPRESSION_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+
+// Common type definitions
+#include "serverless_types.h"
+
+// Codec of a page image in transfer (serverless_pageserver_compression)
+enum PageCompression {
+    PAGE_COMPRESSION_NONE = 0,
+    PAGE_COMPRESSION_LZ4 = 1,      // LZ4 block format
+    PAGE_COMPRESSION_ZSTD = 2      // zstd frame with content size
+};
+
+// HTTP content coding of a codec ("lz4", "zstd"); null for NONE
+const char* page_compression_name(PageCompression codec);
+
+// Codec named by a Content-Encoding value; NONE when not recognised
+PageCompression page_compression_from_name(const char* name, size_t length);
+
+// Whether this build can decode the codec
+bool page_compression_available(PageCompression codec);
+
+/**
+ * Page Decompressor
+ *
+ * Decodes one compressed page image straight into its cache frame.
+ * Keeps the zstd context between pages. Not thread safe; each client
+ * owns one.
+ */
+class PageDecompressor {
+private:
+    void* zstd_context;
+
+public:
+    PageDecompressor();
+    ~PageDecompressor();
+
+    // Delete copy constructor
+    PageDecompressor(const PageDecompressor&) = delete;
+    PageDecompressor& operator=(const PageDecompressor&) = delete;
+
+    // Decode source into frame and zero the rest of the frame. Fails if
+    // the data is corrupt, the codec is unavailable or the image does
+    // not fit in frame_size bytes.
+    int decompress(PageCompression codec, const char* source, size_t source_length,
+                   char* frame, size_t frame_size);
+};
+
+// Transfer savings of every decoded page
+struct PageCompressionStats {
+    uint64_t pages;
+    uint64_t compressed_bytes;      // As received
+    uint64_t uncompressed_bytes;    // After decoding
+};
+
+PageCompressionStats get_page_compression_stats();
+
+#endif /* PAGE_COMPRESSION_H */
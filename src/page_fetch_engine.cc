@@ -0,0 +1,465 @@
+/*
+  Concurrent Page Fetch Engine Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  libcurl multi reactor for concurrent pageserver reads
+*/
+
+#include "page_fetch_engine.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Global fetch engine instance
+std::unique_ptr<PageFetchEngine> global_page_fetch_engine;
+
+// Upper bound on a reactor sleep; submit() and shutdown() wake it early
+static const int REACTOR_POLL_MS = 1000;
+
+// Latencies the hedge delay is computed from, and how often
+static const size_t HEDGE_SAMPLES = 1024;
+static const size_t HEDGE_RECOMPUTE_INTERVAL = 64;
+
+// Hedges are capped at this share of all fetches, so a slow
+// pageserver does not get twice the load
+static const uint64_t HEDGE_BUDGET_PERCENT = 5;
+
+PageFetchEngine::PageFetchEngine(const PageserverShardMap* shard_map, size_t max_requests,
+                                 bool http2, long timeout)
+    : shards(shard_map), max_in_flight(max_requests), timeout_ms(timeout),
+      use_http2(http2), compression(PAGE_COMPRESSION_NONE), page_headers(nullptr),
+      multi_handle(nullptr), hedge_percentile(0), next_sample(0), hedge_delay_us(0),
+      fetches_started(0), shutdown_requested(false)
+{
+}
+
+PageFetchEngine::~PageFetchEngine()
+{
+    shutdown();
+
+    for (CURL* easy : idle_handles) {
+        curl_easy_cleanup(easy);
+    }
+    if (multi_handle) {
+        curl_multi_cleanup(multi_handle);
+    }
+    for (char* buffer : idle_buffers) {
+        free(buffer);
+    }
+    curl_slist_free_all(page_headers);
+}
+
+void PageFetchEngine::set_compression(PageCompression codec)
+{
+    compression = codec;
+    curl_slist_free_all(page_headers);
+    page_headers = nullptr;
+
+    if (codec != PAGE_COMPRESSION_NONE) {
+        char header[64];
+        snprintf(header, sizeof(header), "Accept-Encoding: %s", page_compression_name(codec));
+        page_headers = curl_slist_append(nullptr, header);
+    }
+}
+
+bool PageFetchEngine::initialize()
+{
+    multi_handle = curl_multi_init();
+    if (!multi_handle) {
+        return false;
+    }
+
+    if (use_http2) {
+        curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+
+    idle_handles.reserve(max_in_flight);
+    active_handles.reserve(max_in_flight);
+    if (hedge_percentile > 0) {
+        latency_samples.reserve(HEDGE_SAMPLES);
+    }
+    reactor_thread = std::thread(&PageFetchEngine::reactor_thread_main, this);
+    return true;
+}
+
+void PageFetchEngine::shutdown()
+{
+    if (!reactor_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        shutdown_requested = true;
+    }
+    curl_multi_wakeup(multi_handle);
+    reactor_thread.join();
+}
+
+void PageFetchEngine::submit(PageFetch* fetch)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!shutdown_requested) {
+            queued.push_back(fetch);
+            fetch = nullptr;
+        }
+    }
+
+    if (fetch) {
+        finish_fetch(fetch, false);
+        return;
+    }
+    curl_multi_wakeup(multi_handle);
+}
+
+char* PageFetchEngine::acquire_buffer()
+{
+    if (idle_buffers.empty()) {
+        return (char*)malloc(MARIADB_PAGE_SIZE);
+    }
+    char* buffer = idle_buffers.back();
+    idle_buffers.pop_back();
+    return buffer;
+}
+
+void PageFetchEngine::release_buffer(char** buffer)
+{
+    if (*buffer) {
+        idle_buffers.push_back(*buffer);
+        *buffer = nullptr;
+    }
+}
+
+CURL* PageFetchEngine::start_transfer(PageFetch* fetch, PageBodySink* sink, char* frame,
+                                      char** staging)
+{
+    CURL* easy;
+    if (idle_handles.empty()) {
+        easy = curl_easy_init();
+        if (!easy) {
+            return nullptr;
+        }
+    } else {
+        easy = idle_handles.back();
+        idle_handles.pop_back();
+    }
+
+    // The body goes straight into the frame; compressed bodies are
+    // staged and decoded into it on completion
+    if (page_headers) {
+        *staging = acquire_buffer();
+    }
+    sink->reset(frame, MARIADB_PAGE_SIZE, *staging, *staging ? MARIADB_PAGE_SIZE : 0);
+
+    curl_easy_setopt(easy, CURLOPT_URL, fetch->url);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, response_sink_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, static_cast<ResponseSink*>(sink));
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, PageBodySink::header_callback);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, static_cast<void*>(sink));
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER,
+                     *staging ? page_headers : (struct curl_slist*)nullptr);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, fetch);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    if (use_http2) {
+        // Wait for a stream on a pending connection instead of dialing
+        // a new one for every request queued before it is up
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    }
+
+    if (curl_multi_add_handle(multi_handle, easy) != CURLM_OK) {
+        idle_handles.push_back(easy);
+        release_buffer(staging);
+        return nullptr;
+    }
+
+    active_handles.push_back(easy);
+    return easy;
+}
+
+bool PageFetchEngine::start_fetch(PageFetch* fetch)
+{
+    const PageId& page_id = fetch->handle.page_id();
+    const char* base_url = shards->shard(shards->shard_for(page_id)).url.c_str();
+    if (fetch->lsn) {
+        snprintf(fetch->url, sizeof(fetch->url), "%s/page/%llu/%u?lsn=%llu", base_url,
+                 (unsigned long long)page_id.timeline_id, page_id.page_number,
+                 (unsigned long long)fetch->lsn);
+    } else {
+        snprintf(fetch->url, sizeof(fetch->url), "%s/page/%llu/%u", base_url,
+                 (unsigned long long)page_id.timeline_id, page_id.page_number);
+    }
+
+    fetch->started = std::chrono::steady_clock::now();
+    fetch->primary = start_transfer(fetch, &fetch->sink, fetch->handle.frame(), &fetch->staging);
+    fetches_started++;
+    return fetch->primary != nullptr;
+}
+
+bool PageFetchEngine::start_hedge(PageFetch* fetch)
+{
+    fetch->hedge_frame = acquire_buffer();
+    if (!fetch->hedge_frame) {
+        return false;
+    }
+
+    // Usually lands on another idle handle and therefore another
+    // connection than the straggler
+    fetch->hedge_started = std::chrono::steady_clock::now();
+    fetch->hedge = start_transfer(fetch, &fetch->hedge_sink, fetch->hedge_frame,
+                                  &fetch->hedge_staging);
+    if (!fetch->hedge) {
+        release_buffer(&fetch->hedge_frame);
+        return false;
+    }
+
+    hedges_issued++;
+    return true;
+}
+
+void PageFetchEngine::detach_transfer(CURL* easy)
+{
+    curl_multi_remove_handle(multi_handle, easy);
+    for (size_t i = 0; i < active_handles.size(); ++i) {
+        if (active_handles[i] == easy) {
+            active_handles[i] = active_handles.back();
+            active_handles.pop_back();
+            break;
+        }
+    }
+    idle_handles.push_back(easy);
+}
+
+void PageFetchEngine::complete_transfer(CURL* easy, bool transfer_ok)
+{
+    PageFetch* fetch = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&fetch);
+    detach_transfer(easy);
+
+    // Decode or zero-pad the frame, as read_page() does
+    bool is_hedge = easy == fetch->hedge;
+    bool ok;
+    if (is_hedge) {
+        ok = transfer_ok && fetch->hedge_sink.finish(&decompressor) == 0;
+        fetch->hedge = nullptr;
+        release_buffer(&fetch->hedge_staging);
+    } else {
+        ok = transfer_ok && fetch->sink.finish(&decompressor) == 0;
+        fetch->primary = nullptr;
+        release_buffer(&fetch->staging);
+    }
+
+    if (!ok) {
+        // The other request of a hedged fetch may still succeed
+        if (fetch->primary || fetch->hedge) {
+            return;
+        }
+        release_buffer(&fetch->hedge_frame);
+        fetches_failed++;
+        finish_fetch(fetch, false);
+        return;
+    }
+
+    // First good answer wins; the loser is cut off before it can
+    // write into the frame again
+    if (fetch->primary) {
+        detach_transfer(fetch->primary);
+        fetch->primary = nullptr;
+        release_buffer(&fetch->staging);
+    }
+    if (fetch->hedge) {
+        detach_transfer(fetch->hedge);
+        fetch->hedge = nullptr;
+        release_buffer(&fetch->hedge_staging);
+    }
+    if (is_hedge) {
+        memcpy(fetch->handle.frame(), fetch->hedge_frame, MARIADB_PAGE_SIZE);
+        hedges_won++;
+    }
+    release_buffer(&fetch->hedge_frame);
+
+    record_latency(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - (is_hedge ? fetch->hedge_started : fetch->started)).count());
+    fetches_completed++;
+    finish_fetch(fetch, true);
+}
+
+void PageFetchEngine::record_latency(uint64_t sample_us)
+{
+    // Moving average, weight 1/8 for the new sample; only the reactor
+    // writes it
+    uint64_t average = latency_us.load(std::memory_order_relaxed);
+    latency_us.store(average ? (average * 7 + sample_us) / 8 : sample_us,
+                     std::memory_order_relaxed);
+
+    if (hedge_percentile <= 0) {
+        return;
+    }
+
+    uint32_t sample = sample_us > UINT32_MAX ? UINT32_MAX : (uint32_t)sample_us;
+    if (latency_samples.size() < HEDGE_SAMPLES) {
+        latency_samples.push_back(sample);
+    } else {
+        latency_samples[next_sample % HEDGE_SAMPLES] = sample;
+    }
+    next_sample++;
+
+    if (next_sample % HEDGE_RECOMPUTE_INTERVAL != 0) {
+        return;
+    }
+
+    std::vector<uint32_t> sorted(latency_samples);
+    size_t rank = (size_t)(hedge_percentile / 100.0 * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    hedge_delay_us = sorted[rank] ? sorted[rank] : 1;
+}
+
+int PageFetchEngine::issue_hedges()
+{
+    int wait_ms = REACTOR_POLL_MS;
+    if (hedge_delay_us == 0) {
+        return wait_ms;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto delay = std::chrono::microseconds(hedge_delay_us);
+
+    // Hedges started here are appended; only look at earlier handles
+    size_t active = active_handles.size();
+    for (size_t i = 0; i < active; ++i) {
+        PageFetch* fetch = nullptr;
+        curl_easy_getinfo(active_handles[i], CURLINFO_PRIVATE, (char**)&fetch);
+        if (active_handles[i] != fetch->primary || fetch->hedge) {
+            continue;
+        }
+
+        auto due = fetch->started + delay;
+        if (due > now) {
+            int due_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                due - now + std::chrono::microseconds(999)).count();
+            wait_ms = std::min(wait_ms, due_ms);
+            continue;
+        }
+
+        if (hedges_issued * 100 >= fetches_started * HEDGE_BUDGET_PERCENT ||
+            active_handles.size() >= max_in_flight) {
+            continue;
+        }
+        if (start_hedge(fetch)) {
+            wait_ms = 0;    // Let curl start it right away
+        }
+    }
+    return wait_ms;
+}
+
+void PageFetchEngine::finish_fetch(PageFetch* fetch, bool ok)
+{
+    if (ok) {
+        global_page_cache->publish(&fetch->handle, fetch->lsn);
+    } else {
+        fetch->handle.release();
+    }
+
+    if (fetch->group) {
+        // The submitter may free the fetch as soon as the group is done
+        fetch->group->complete(ok);
+    } else {
+        delete fetch;
+    }
+}
+
+void PageFetchEngine::reactor_thread_main()
+{
+    std::vector<PageFetch*> starting;
+    starting.reserve(max_in_flight);
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (shutdown_requested) {
+                break;
+            }
+            while (!queued.empty() && active_handles.size() + starting.size() < max_in_flight) {
+                starting.push_back(queued.front());
+                queued.pop_front();
+            }
+        }
+
+        for (PageFetch* fetch : starting) {
+            if (!start_fetch(fetch)) {
+                fetches_failed++;
+                finish_fetch(fetch, false);
+            }
+        }
+        starting.clear();
+
+        if (active_handles.size() > peak_in_flight) {
+            peak_in_flight = active_handles.size();
+        }
+
+        int running;
+        curl_multi_perform(multi_handle, &running);
+
+        CURLMsg* message;
+        int remaining;
+        while ((message = curl_multi_info_read(multi_handle, &remaining))) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            long response_code = 0;
+            if (message->data.result == CURLE_OK) {
+                curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &response_code);
+            }
+            complete_transfer(message->easy_handle, response_code == 200);
+        }
+
+        int wait_ms = issue_hedges();
+        curl_multi_poll(multi_handle, nullptr, 0, wait_ms, nullptr);
+    }
+
+    // Fail everything still in flight or queued so no waiter hangs
+    while (!active_handles.empty()) {
+        PageFetch* fetch = nullptr;
+        curl_easy_getinfo(active_handles.back(), CURLINFO_PRIVATE, (char**)&fetch);
+        if (fetch->primary) {
+            detach_transfer(fetch->primary);
+            fetch->primary = nullptr;
+        }
+        if (fetch->hedge) {
+            detach_transfer(fetch->hedge);
+            fetch->hedge = nullptr;
+        }
+        release_buffer(&fetch->staging);
+        release_buffer(&fetch->hedge_staging);
+        release_buffer(&fetch->hedge_frame);
+        fetches_failed++;
+        finish_fetch(fetch, false);
+    }
+
+    std::deque<PageFetch*> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        abandoned.swap(queued);
+    }
+    for (PageFetch* fetch : abandoned) {
+        fetches_failed++;
+        finish_fetch(fetch, false);
+    }
+}
+
+PageFetchEngine::FetchStats PageFetchEngine::get_stats() const
+{
+    FetchStats stats;
+    stats.completed = fetches_completed.load();
+    stats.failed = fetches_failed.load();
+    stats.peak_in_flight = peak_in_flight.load();
+    stats.average_latency_us = latency_us.load();
+    stats.hedges_issued = hedges_issued.load();
+    stats.hedges_won = hedges_won.load();
+    stats.http2 = use_http2;
+    return stats;
+}
@@ -0,0 +1,227 @@
+/*
+  Concurrent Page Fetch Engine for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Event-driven page reader built on the libcurl multi interface. A
+  single reactor thread keeps hundreds of page requests in flight,
+  where a pooled PageserverClient can only wait for one at a time.
+  Optionally speaks HTTP/2 so the requests share a few connections,
+  and hedges requests that take unusually long.
+*/
+
+#ifndef PAGE_FETCH_ENGINE_H
+#define PAGE_FETCH_ENGINE_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <curl/curl.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+#include "page_cache.h"
+#include "pageserver_client.h"
+#include "pageserver_shard_map.h"
+
+/**
+ * Completion counter for a set of fetches
+ *
+ * The submitter adds every fetch it queues and then waits until the
+ * engine has completed all of them.
+ */
+class PageFetchGroup {
+private:
+    std::mutex mutex;
+    std::condition_variable all_done;
+    size_t outstanding;
+    size_t failures;
+
+public:
+    PageFetchGroup() : outstanding(0), failures(0) {}
+
+    void add() {
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding++;
+    }
+
+    void complete(bool ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) {
+            failures++;
+        }
+        if (--outstanding == 0) {
+            all_done.notify_all();
+        }
+    }
+
+    // Wait for every added fetch; returns the number that failed
+    size_t wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [this] { return outstanding == 0; });
+        return failures;
+    }
+};
+
+/**
+ * One page read into a reserved cache frame
+ *
+ * On success the engine publishes the frame at lsn, leaving the
+ * handle as an ordinary pin; on failure it abandons the reservation
+ * and the handle becomes invalid. Fetches with a group stay owned by
+ * the submitter, who reads the page through the handle once the
+ * group is done. Fetches without a group are owned by the engine,
+ * which releases and deletes them once complete (fire-and-forget
+ * prefetch).
+ */
+struct PageFetch {
+    PageHandle handle;      // From PageCache::pin() (PIN_MISS) or reserve()
+    uint64_t lsn;
+    PageFetchGroup* group;
+
+    // Engine state
+    char url[256];
+    CURL* primary;          // First request; null once it has ended
+    PageBodySink sink;
+    char* staging;          // Compressed body, when compression is on
+    std::chrono::steady_clock::time_point started;
+
+    // Duplicate request of a hedged fetch, received into a frame of
+    // its own and copied into the cache frame if it wins
+    CURL* hedge;
+    PageBodySink hedge_sink;
+    char* hedge_frame;
+    char* hedge_staging;
+    std::chrono::steady_clock::time_point hedge_started;
+
+    PageFetch()
+        : lsn(0), group(nullptr), primary(nullptr), staging(nullptr), hedge(nullptr),
+          hedge_frame(nullptr), hedge_staging(nullptr) {}
+};
+
+/**
+ * Page Fetch Engine
+ *
+ * Fetches are queued by any thread and picked up by the reactor,
+ * which attaches them to the multi handle up to the in-flight limit.
+ * Response bodies are written directly into the cache frames.
+ * Easy handles are recycled so their connections stay open.
+ *
+ * With HTTP/2 (cleartext, prior knowledge) every request becomes a
+ * stream multiplexed over an existing connection; a new connection
+ * is opened only when the server's stream limit is reached. With
+ * HTTP/1.1 each in-flight request holds a connection of its own.
+ *
+ * With hedging on, a fetch still running after a chosen percentile of
+ * recent latencies gets a duplicate request; the first good answer
+ * is kept and the other request is cancelled. Hedges are limited to
+ * a small share of all fetches.
+ */
+class PageFetchEngine {
+private:
+    const PageserverShardMap* shards;
+    size_t max_in_flight;
+    long timeout_ms;
+    bool use_http2;
+    PageCompression compression;
+    struct curl_slist* page_headers;
+
+    // Reactor thread only
+    CURLM* multi_handle;
+    std::vector<CURL*> idle_handles;
+    std::vector<CURL*> active_handles;
+    std::vector<char*> idle_buffers;        // Page sized, for staging and hedges
+    PageDecompressor decompressor;
+
+    // Hedging: duplicate a request that is still running after the
+    // hedge_percentile of recent latencies (reactor thread only)
+    double hedge_percentile;                // Zero: no hedging
+    std::vector<uint32_t> latency_samples;  // Ring of recent latencies (us)
+    size_t next_sample;
+    uint64_t hedge_delay_us;                // Zero until enough samples
+    uint64_t fetches_started;
+
+    std::thread reactor_thread;
+    std::mutex queue_mutex;
+    std::deque<PageFetch*> queued;
+    bool shutdown_requested;
+
+    // Statistics
+    std::atomic<uint64_t> fetches_completed{0};
+    std::atomic<uint64_t> fetches_failed{0};
+    std::atomic<uint64_t> peak_in_flight{0};
+    std::atomic<uint64_t> latency_us{0};     // Moving average of successful fetches
+    std::atomic<uint64_t> hedges_issued{0};
+    std::atomic<uint64_t> hedges_won{0};
+
+    void reactor_thread_main();
+    bool start_fetch(PageFetch* fetch);
+    bool start_hedge(PageFetch* fetch);
+    CURL* start_transfer(PageFetch* fetch, PageBodySink* sink, char* frame, char** staging);
+    void detach_transfer(CURL* easy);
+    void complete_transfer(CURL* easy, bool transfer_ok);
+    int issue_hedges();
+    void record_latency(uint64_t sample_us);
+    char* acquire_buffer();
+    void release_buffer(char** buffer);
+    void finish_fetch(PageFetch* fetch, bool ok);
+
+public:
+    // Each page is requested from its shard of the map, which must
+    // outlive the engine
+    PageFetchEngine(const PageserverShardMap* shard_map, size_t max_requests, bool http2 = false,
+                    long timeout = 30000);
+    ~PageFetchEngine();
+
+    // Ask for compressed page images; call before initialize()
+    void set_compression(PageCompression codec);
+
+    // Duplicate requests still running after this percentile (0-100)
+    // of recent fetch latencies; 0 disables. Call before initialize().
+    void set_hedging(double percentile) { hedge_percentile = percentile; }
+    bool hedging() const { return hedge_percentile > 0; }
+
+    // Create the multi handle and start the reactor thread
+    bool initialize();
+
+    // Stop the reactor; fetches still queued or in flight fail
+    void shutdown();
+
+    // Queue a fetch. The engine reads fetch->handle's page at
+    // fetch->lsn; the group must have been add()ed for it.
+    void submit(PageFetch* fetch);
+
+    // Typical time from starting a fetch to its completion; zero until
+    // the first fetch has succeeded
+    uint64_t average_latency_us() const { return latency_us.load(std::memory_order_relaxed); }
+
+    // Statistics and monitoring
+    struct FetchStats {
+        uint64_t completed;
+        uint64_t failed;
+        uint64_t peak_in_flight;
+        uint64_t average_latency_us;
+        uint64_t hedges_issued;
+        uint64_t hedges_won;
+        bool http2;
+    };
+
+    FetchStats get_stats() const;
+};
+
+// Global fetch engine instance
+extern std::unique_ptr<PageFetchEngine> global_page_fetch_engine;
+
+#endif /* PAGE_FETCH_ENGINE_H */
@@ -0,0 +1,230 @@
+/*
+  Page Service Client Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Binary pageserver protocol over persistent TCP
+*/
+
+#include "page_service_client.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Requests sent before reading any response
+static const size_t MAX_PIPELINED_REQUESTS = 256;
+
+PageServiceClient::PageServiceClient(const char* host, int port, long timeout)
+    : server_host(strdup(host)), server_port(port), timeout_seconds(timeout),
+      socket_fd(-1), next_request_id(1), compression(PAGE_COMPRESSION_NONE)
+{
+}
+
+PageServiceClient::~PageServiceClient()
+{
+    close_connection();
+    free(server_host);
+}
+
+int PageServiceClient::establish_connection()
+{
+    if (socket_fd >= 0) {
+        return 0;
+    }
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", server_port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addresses;
+    if (getaddrinfo(server_host, port, &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    for (struct addrinfo* address = addresses; address; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            socket_fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+
+    if (socket_fd < 0) {
+        return -1;
+    }
+
+    // Small requests must not wait for Nagle; a stalled server must
+    // not hang the reader forever
+    int nodelay = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    struct timeval timeout;
+    timeout.tv_sec = timeout_seconds;
+    timeout.tv_usec = 0;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    return 0;
+}
+
+void PageServiceClient::close_connection()
+{
+    if (socket_fd >= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+    }
+}
+
+int PageServiceClient::send_all(const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(socket_fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+int PageServiceClient::receive_all(char* buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t received = recv(socket_fd, buffer, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return -1;
+        }
+        buffer += received;
+        length -= received;
+    }
+    return 0;
+}
+
+int PageServiceClient::read_page(const PageId& page_id, char* buffer, size_t buffer_size,
+                                 uint64_t lsn)
+{
+    if (buffer_size < MARIADB_PAGE_SIZE) {
+        return -1;
+    }
+
+    uint32_t page_number = page_id.page_number;
+    if (read_page_batch(TimelineId(page_id.timeline_id), &page_number, &buffer, 1, lsn) != 0) {
+        return -1;
+    }
+
+    if (buffer_size > MARIADB_PAGE_SIZE) {
+        memset(buffer + MARIADB_PAGE_SIZE, 0, buffer_size - MARIADB_PAGE_SIZE);
+    }
+    return 0;
+}
+
+int PageServiceClient::read_pages(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                                  char* const* frames, size_t count, uint64_t lsn)
+{
+    for (size_t offset = 0; offset < count; offset += MAX_PIPELINED_REQUESTS) {
+        size_t batch = count - offset < MAX_PIPELINED_REQUESTS ? count - offset : MAX_PIPELINED_REQUESTS;
+        if (read_page_batch(timeline_id, page_numbers + offset, frames + offset, batch, lsn) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int PageServiceClient::read_page_batch(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                                       char* const* frames, size_t count, uint64_t lsn)
+{
+    if (establish_connection() != 0) {
+        return -1;
+    }
+
+    // Send every request in one write, then collect the responses
+    uint64_t first_id = next_request_id;
+    next_request_id += count;
+
+    request_buffer.resize(count * PAGE_SERVICE_REQUEST_SIZE);
+    for (size_t i = 0; i < count; ++i) {
+        char* request = &request_buffer[i * PAGE_SERVICE_REQUEST_SIZE];
+        int4store(request, PAGE_SERVICE_MAGIC);
+        int2store(request + 4, PAGE_SERVICE_GET_PAGE);
+        int2store(request + 6, compression);
+        int8store(request + 8, first_id + i);
+        int8store(request + 16, timeline_id.id);
+        int8store(request + 24, lsn);
+        int4store(request + 32, page_numbers[i]);
+        int4store(request + 36, 0);
+    }
+
+    if (send_all(request_buffer.data(), request_buffer.size()) != 0) {
+        close_connection();
+        return -1;
+    }
+
+    answered.assign(count, 0);
+    size_t failures = 0;
+
+    for (size_t n = 0; n < count; ++n) {
+        char header[PAGE_SERVICE_RESPONSE_SIZE];
+        if (receive_all(header, sizeof(header)) != 0) {
+            close_connection();
+            return -1;
+        }
+
+        uint64_t index = uint8korr(header + 8) - first_id;
+        uint32_t payload_length = uint4korr(header + 24);
+        PageCompression encoding = (PageCompression)uint2korr(header + 6);
+
+        // Anything unexpected leaves the stream out of sync: drop it
+        if (uint4korr(header) != PAGE_SERVICE_MAGIC || index >= count || answered[index] ||
+            payload_length > MARIADB_PAGE_SIZE) {
+            close_connection();
+            return -1;
+        }
+        answered[index] = 1;
+
+        // A plain page image lands directly in its frame; a compressed
+        // one is decoded into it
+        char* target = frames[index];
+        if (encoding != PAGE_COMPRESSION_NONE) {
+            staging_buffer.resize(MARIADB_PAGE_SIZE);
+            target = staging_buffer.data();
+        }
+        if (payload_length > 0 && receive_all(target, payload_length) != 0) {
+            close_connection();
+            return -1;
+        }
+
+        if (uint2korr(header + 4) != PAGE_SERVICE_OK) {
+            failures++;
+        } else if (encoding != PAGE_COMPRESSION_NONE) {
+            if (decompressor.decompress(encoding, target, payload_length,
+                                        frames[index], MARIADB_PAGE_SIZE) != 0) {
+                failures++;
+            }
+        } else if (payload_length < MARIADB_PAGE_SIZE) {
+            memset(frames[index] + payload_length, 0, MARIADB_PAGE_SIZE - payload_length);
+        }
+    }
+
+    return failures ? -1 : 0;
+}
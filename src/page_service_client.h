@@ -0,0 +1,106 @@
+/*
+  Page Service Client for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Binary page protocol over a persistent TCP connection to the
+  pageserver, as an alternative to one HTTP request per page.
+*/
+
+#ifndef PAGE_SERVICE_CLIENT_H
+#define PAGE_SERVICE_CLIENT_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+#include "page_compression.h"
+
+/*
+  Wire format. All integers are little-endian.
+
+  Request (PAGE_SERVICE_REQUEST_SIZE bytes):
+    0   uint32  magic           PAGE_SERVICE_MAGIC
+    4   uint16  type            PAGE_SERVICE_GET_PAGE
+    6   uint16  flags           PageCompression the client accepts
+    8   uint64  request_id      echoed in the response
+    16  uint64  timeline_id
+    24  uint64  lsn             0: latest
+    32  uint32  page_number
+    36  uint32  reserved
+
+  Response header (PAGE_SERVICE_RESPONSE_SIZE bytes), followed by
+  payload_length bytes of page image:
+    0   uint32  magic
+    4   uint16  status          PAGE_SERVICE_OK or an error code
+    6   uint16  flags           PageCompression of the payload
+    8   uint64  request_id
+    16  uint64  lsn             LSN the image is valid at
+    24  uint32  payload_length  at most MARIADB_PAGE_SIZE, compressed
+                                or not
+    28  uint32  reserved
+
+  Requests may be pipelined; responses carry the request id, so the
+  server is free to answer them in any order.
+*/
+static const uint32_t PAGE_SERVICE_MAGIC = 0x31535053;     // "SPS1"
+static const uint16_t PAGE_SERVICE_GET_PAGE = 1;
+static const uint16_t PAGE_SERVICE_OK = 0;
+static const size_t PAGE_SERVICE_REQUEST_SIZE = 40;
+static const size_t PAGE_SERVICE_RESPONSE_SIZE = 32;
+
+/**
+ * Page Service Client
+ *
+ * Keeps one TCP connection open and reconnects on the next call
+ * after an I/O or protocol error. Not thread safe; each pooled
+ * PageserverClient owns one.
+ */
+class PageServiceClient {
+private:
+    char* server_host;
+    int server_port;
+    long timeout_seconds;
+    int socket_fd;
+    uint64_t next_request_id;
+    PageCompression compression;
+
+    // Encoded requests and answered flags of the current batch,
+    // reused across calls
+    std::vector<char> request_buffer;
+    std::vector<uint8_t> answered;
+
+    // Compressed payloads are received here and decoded into the frame
+    std::vector<char> staging_buffer;
+    PageDecompressor decompressor;
+
+    int establish_connection();
+    void close_connection();
+    int send_all(const char* data, size_t length);
+    int receive_all(char* buffer, size_t length);
+    int read_page_batch(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                        char* const* frames, size_t count, uint64_t lsn);
+
+public:
+    PageServiceClient(const char* host, int port, long timeout = 30);
+    ~PageServiceClient();
+
+    // Same contract as the PageserverClient methods of the same name
+    int read_page(const PageId& page_id, char* buffer, size_t buffer_size, uint64_t lsn = 0);
+    int read_pages(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                   char* const* frames, size_t count, uint64_t lsn = 0);
+
+    // Codec announced in every request
+    void set_compression(PageCompression codec) { compression = codec; }
+
+    bool is_connected() const { return socket_fd >= 0; }
+};
+
+#endif /* PAGE_SERVICE_CLIENT_H */
@@ -6,28 +6,150 @@
 */
 
 #include "pageserver_client.h"
+#include "page_service_client.h"
 #include "ha_serverless.h"
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <cctype>
+#include <strings.h>
+
+// Pages per batched request (4MB response)
+static const size_t MAX_PAGES_PER_REQUEST = 256;
 
 // HTTP response callback for libcurl
-size_t PageserverClient::write_callback(void* contents, size_t size, size_t nmemb, HttpResponse* response)
+size_t response_sink_callback(void* contents, size_t size, size_t nmemb, void* sink)
 {
     size_t total_size = size * nmemb;
     
-    response->data = (char*)realloc(response->data, response->size + total_size + 1);
-    if (response->data) {
-        memcpy(&(response->data[response->size]), contents, total_size);
-        response->size += total_size;
-        response->data[response->size] = 0;  // Null terminate
+    if (!static_cast<ResponseSink*>(sink)->append((const char*)contents, total_size)) {
+        return 0;  // Abort the transfer
     }
-    
     return total_size;
 }
 
+bool FrameSink::append(const char* data, size_t length)
+{
+    if (length > capacity - received) {
+        overflow = true;
+        return false;
+    }
+    
+    memcpy(frame + received, data, length);
+    received += length;
+    return true;
+}
+
+void FrameSink::pad()
+{
+    if (received < capacity) {
+        memset(frame + received, 0, capacity - received);
+    }
+}
+
+bool PageBodySink::append(const char* data, size_t length)
+{
+    if (encoding == PAGE_COMPRESSION_NONE) {
+        return plain.append(data, length);
+    }
+    return staged.append(data, length);
+}
+
+size_t PageBodySink::header_callback(char* buffer, size_t size, size_t nitems, void* sink)
+{
+    size_t length = size * nitems;
+    static const char name[] = "content-encoding:";
+    const size_t name_length = sizeof(name) - 1;
+    
+    if (sink && length > name_length && strncasecmp(buffer, name, name_length) == 0) {
+        const char* value = buffer + name_length;
+        const char* end = buffer + length;
+        while (value < end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) {
+            end--;
+        }
+        PageBodySink* page_sink = static_cast<PageBodySink*>(sink);
+        page_sink->encoding = page_compression_from_name(value, end - value);
+        page_sink->unknown_encoding = page_sink->encoding == PAGE_COMPRESSION_NONE &&
+            end > value && !(end - value == 8 && strncasecmp(value, "identity", 8) == 0);
+    }
+    return length;
+}
+
+int PageBodySink::finish(PageDecompressor* decompressor)
+{
+    if (unknown_encoding) {
+        return -1;
+    }
+    
+    if (encoding == PAGE_COMPRESSION_NONE) {
+        if (plain.overflowed() || plain.size() == 0) {
+            return -1;
+        }
+        plain.pad();
+        return 0;
+    }
+    
+    if (staged.overflowed() || staged.size() == 0) {
+        return -1;
+    }
+    return decompressor->decompress(encoding, staging_area, staged.size(), page_frame, page_size);
+}
+
+bool ScatterSink::append(const char* data, size_t length)
+{
+    while (length > 0) {
+        size_t page = received / MARIADB_PAGE_SIZE;
+        if (page >= count) {
+            return false;  // More data than requested
+        }
+        
+        size_t offset = received % MARIADB_PAGE_SIZE;
+        size_t chunk = MARIADB_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        
+        memcpy(frames[page] + offset, data, chunk);
+        received += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    
+    return true;
+}
+
+bool ControlBuffer::append(const char* data, size_t length)
+{
+    if (length > limit - used) {
+        return false;
+    }
+    
+    // Keep room for the terminator; grow geometrically
+    if (used + length + 1 > capacity) {
+        size_t new_capacity = capacity ? capacity : 512;
+        while (new_capacity < used + length + 1) {
+            new_capacity *= 2;
+        }
+        char* grown = (char*)realloc(buffer, new_capacity);
+        if (!grown) {
+            return false;
+        }
+        buffer = grown;
+        capacity = new_capacity;
+    }
+    
+    memcpy(buffer + used, data, length);
+    used += length;
+    buffer[used] = 0;
+    return true;
+}
+
 PageserverClient::PageserverClient(const char* pageserver_url, long timeout)
-    : curl_handle(nullptr), base_url(nullptr), timeout_seconds(timeout)
+    : curl_handle(nullptr), base_url(nullptr), timeout_seconds(timeout), page_service(nullptr),
+      compression(PAGE_COMPRESSION_NONE), page_headers(nullptr), staging_buffer(nullptr)
 {
     // Initialize libcurl
     curl_handle = curl_easy_init();
@@ -38,7 +160,9 @@ PageserverClient::PageserverClient(const char* pageserver_url, long timeout)
     // Configure curl options
     if (curl_handle) {
         curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, timeout_seconds);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, response_sink_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, PageBodySink::header_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)nullptr);
         curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
     }
 }
@@ -51,6 +175,9 @@ PageserverClient::~PageserverClient()
     if (base_url) {
         free(base_url);
     }
+    delete page_service;
+    curl_slist_free_all(page_headers);
+    free(staging_buffer);
 }
 
 void PageserverClient::set_base_url(const char* url)
@@ -61,14 +188,41 @@ void PageserverClient::set_base_url(const char* url)
     base_url = strdup(url);
 }
 
-int PageserverClient::make_http_request(const char* url, HttpResponse* response)
+void PageserverClient::set_page_service(const char* host, int port)
+{
+    delete page_service;
+    page_service = new PageServiceClient(host, port, timeout_seconds);
+    page_service->set_compression(compression);
+}
+
+void PageserverClient::set_compression(PageCompression codec)
+{
+    compression = codec;
+    curl_slist_free_all(page_headers);
+    page_headers = nullptr;
+    
+    if (codec != PAGE_COMPRESSION_NONE) {
+        char header[64];
+        snprintf(header, sizeof(header), "Accept-Encoding: %s", page_compression_name(codec));
+        page_headers = curl_slist_append(nullptr, header);
+        if (!staging_buffer) {
+            staging_buffer = (char*)malloc(MARIADB_PAGE_SIZE);
+        }
+    }
+    
+    if (page_service) {
+        page_service->set_compression(codec);
+    }
+}
+
+int PageserverClient::make_http_request(const char* url, ResponseSink* sink)
 {
     if (!curl_handle) {
         return -1;
     }
     
     curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, response);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, sink);
     
     CURLcode res = curl_easy_perform(curl_handle);
     if (res != CURLE_OK) {
@@ -81,68 +235,261 @@ int PageserverClient::make_http_request(const char* url, HttpResponse* response)
     return (response_code == 200) ? 0 : -1;
 }
 
-char* PageserverClient::build_page_url(const PageId& page_id)
+void PageserverClient::build_page_url(const PageId& page_id, uint64_t lsn, char* url, size_t url_size)
 {
-    char* url = (char*)malloc(256);
-    snprintf(url, 256, "%s/page/%llu/%u", base_url, (unsigned long long)page_id.timeline_id, page_id.page_number);
-    return url;
+    if (lsn) {
+        snprintf(url, url_size, "%s/page/%llu/%u?lsn=%llu", base_url,
+                 (unsigned long long)page_id.timeline_id, page_id.page_number,
+                 (unsigned long long)lsn);
+    } else {
+        snprintf(url, url_size, "%s/page/%llu/%u", base_url, (unsigned long long)page_id.timeline_id, page_id.page_number);
+    }
 }
 
-char* PageserverClient::build_timeline_url(const TimelineId& timeline_id)
+void PageserverClient::build_timeline_url(const TimelineId& timeline_id, char* url, size_t url_size)
 {
-    char* url = (char*)malloc(256);
-    snprintf(url, 256, "%s/timeline/%llu", base_url, (unsigned long long)timeline_id.id);
-    return url;
+    snprintf(url, url_size, "%s/timeline/%llu", base_url, (unsigned long long)timeline_id.id);
 }
 
-int PageserverClient::read_page(const PageId& page_id, char* buffer, size_t buffer_size)
+int PageserverClient::read_page(const PageId& page_id, char* buffer, size_t buffer_size,
+                                uint64_t lsn)
 {
-    char* url = build_page_url(page_id);
-    HttpResponse response;
+    if (page_service) {
+        return page_service->read_page(page_id, buffer, buffer_size, lsn);
+    }
+    
+    char url[256];
+    build_page_url(page_id, lsn, url, sizeof(url));
+    
+    // The body goes straight into the caller's buffer, or is decoded
+    // into it from the staging area when it arrives compressed
+    PageBodySink sink;
+    bool compressed = page_headers && staging_buffer;
+    sink.reset(buffer, buffer_size, staging_buffer, compressed ? MARIADB_PAGE_SIZE : 0);
+    
+    if (compressed) {
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, page_headers);
+    }
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, static_cast<void*>(&sink));
+    int result = make_http_request(url, &sink);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)nullptr);
+    if (compressed) {
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, (struct curl_slist*)nullptr);
+    }
     
-    int result = make_http_request(url, &response);
+    if (result != 0) {
+        return -1;
+    }
+    return sink.finish(&decompressor);
+}
+
+int PageserverClient::read_pages(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                                 char* const* frames, size_t count, uint64_t lsn)
+{
+    if (page_service) {
+        return page_service->read_pages(timeline_id, page_numbers, frames, count, lsn);
+    }
     
-    if (result == 0 && response.data && response.size <= buffer_size) {
-        memcpy(buffer, response.data, response.size);
-        // Pad with zeros if needed
-        if (response.size < buffer_size) {
-            memset(buffer + response.size, 0, buffer_size - response.size);
+    for (size_t offset = 0; offset < count; offset += MAX_PAGES_PER_REQUEST) {
+        size_t batch = count - offset < MAX_PAGES_PER_REQUEST ? count - offset : MAX_PAGES_PER_REQUEST;
+        if (read_page_batch(timeline_id, page_numbers + offset, frames + offset, batch, lsn) != 0) {
+            return -1;
         }
+    }
+    return 0;
+}
+
+int PageserverClient::read_page_batch(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                                      char* const* frames, size_t count, uint64_t lsn)
+{
+    if (!curl_handle) {
+        return -1;
+    }
+    
+    char url[256];
+    if (lsn) {
+        snprintf(url, sizeof(url), "%s/pages/%llu?lsn=%llu", base_url,
+                 (unsigned long long)timeline_id.id, (unsigned long long)lsn);
     } else {
-        result = -1;
+        snprintf(url, sizeof(url), "%s/pages/%llu", base_url, (unsigned long long)timeline_id.id);
     }
     
-    free(url);
-    return result;
+    // Body: {"pages":[n,n,...]}
+    size_t body_capacity = count * 11 + 16;
+    char* body = (char*)malloc(body_capacity);
+    if (!body) {
+        return -1;
+    }
+    size_t length = snprintf(body, body_capacity, "{\"pages\":[");
+    for (size_t i = 0; i < count; ++i) {
+        length += snprintf(body + length, body_capacity - length, i ? ",%u" : "%u", page_numbers[i]);
+    }
+    length += snprintf(body + length, body_capacity - length, "]}");
+    
+    struct curl_slist* headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    ScatterSink sink(frames, count);
+    
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)length);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<ResponseSink*>(&sink));
+    
+    CURLcode res = curl_easy_perform(curl_handle);
+    long response_code = 0;
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code);
+    }
+    
+    // Restore the single page request setup
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, (struct curl_slist*)nullptr);
+    curl_slist_free_all(headers);
+    free(body);
+    
+    if (response_code != 200 || !sink.complete()) {
+        return -1;
+    }
+    return 0;
 }
 
-int PageserverClient::get_timeline_info(const TimelineId& timeline_id, uint64_t* latest_lsn)
+// Find a member of the outermost JSON object; returns its value with
+// leading whitespace skipped, or null. Nested objects are not searched.
+static const char* json_member(const char* json, const char* key)
+{
+    size_t key_length = strlen(key);
+    int depth = 0;
+    
+    for (const char* p = json; *p; ++p) {
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == '"') {
+            const char* start = ++p;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1]) {
+                    p++;
+                }
+                p++;
+            }
+            if (!*p) {
+                return nullptr;
+            }
+            if (depth != 1 || (size_t)(p - start) != key_length ||
+                memcmp(start, key, key_length) != 0) {
+                continue;
+            }
+            
+            // A key is followed by a colon; a string value is not
+            const char* value = p + 1;
+            while (isspace((unsigned char)*value)) {
+                value++;
+            }
+            if (*value != ':') {
+                continue;
+            }
+            value++;
+            while (isspace((unsigned char)*value)) {
+                value++;
+            }
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+// Parse an unsigned JSON value: a number, a string of digits or an
+// LSN string in the "hi/lo" hexadecimal notation of Postgres
+static bool json_uint(const char* value, uint64_t* result)
 {
-    char* url = build_timeline_url(timeline_id);
-    HttpResponse response;
+    if (!value) {
+        return false;
+    }
+    
+    bool quoted = *value == '"';
+    if (quoted) {
+        value++;
+    }
+    if (!isxdigit((unsigned char)*value)) {
+        return false;
+    }
     
-    int result = make_http_request(url, &response);
+    char* stop;
+    if (quoted) {
+        const char* slash = value;
+        while (isxdigit((unsigned char)*slash)) {
+            slash++;
+        }
+        if (*slash == '/') {
+            uint64_t high = strtoull(value, nullptr, 16);
+            uint64_t low = strtoull(slash + 1, &stop, 16);
+            if (stop == slash + 1 || *stop != '"') {
+                return false;
+            }
+            *result = (high << 32) | (low & 0xffffffff);
+            return true;
+        }
+    }
+    
+    uint64_t number = strtoull(value, &stop, 10);
+    if (stop == value || (quoted && *stop != '"')) {
+        return false;
+    }
+    *result = number;
+    return true;
+}
+
+int PageserverClient::get_timeline_info(const TimelineId& timeline_id, TimelineInfo* info)
+{
+    char url[256];
+    build_timeline_url(timeline_id, url, sizeof(url));
+    control_response.clear();
     
-    if (result == 0 && response.data) {
-        // Parse JSON response for LSN (simplified)
-        *latest_lsn = 1;  // Placeholder
+    if (make_http_request(url, &control_response) != 0) {
+        return -1;
+    }
+    
+    const char* json = control_response.data();
+    *info = TimelineInfo();
+    
+    bool has_lsn = json_uint(json_member(json, "last_record_lsn"), &info->last_record_lsn);
+    if (json_uint(json_member(json, "latest_lsn"), &info->latest_lsn)) {
+        has_lsn = true;
     } else {
-        result = -1;
+        info->latest_lsn = info->last_record_lsn;
+    }
+    if (!has_lsn) {
+        return -1;
     }
     
-    free(url);
-    return result;
+    // Optional; left at zero when the pageserver does not report them
+    json_uint(json_member(json, "page_count"), &info->page_count);
+    if (!json_uint(json_member(json, "current_logical_size"), &info->logical_size)) {
+        json_uint(json_member(json, "logical_size"), &info->logical_size);
+    }
+    return 0;
+}
+
+int PageserverClient::get_timeline_info(const TimelineId& timeline_id, uint64_t* latest_lsn)
+{
+    TimelineInfo info;
+    if (get_timeline_info(timeline_id, &info) != 0) {
+        return -1;
+    }
+    *latest_lsn = info.latest_lsn;
+    return 0;
 }
 
 int PageserverClient::create_timeline(const TimelineId& timeline_id)
 {
-    char* url = build_timeline_url(timeline_id);
-    HttpResponse response;
+    char url[256];
+    build_timeline_url(timeline_id, url, sizeof(url));
+    control_response.clear();
     
     // For now, just check if timeline exists
-    int result = make_http_request(url, &response);
+    int result = make_http_request(url, &control_response);
     
-    free(url);
     return (result == 0) ? 0 : -1;  // Return actual result
 }
 
@@ -154,14 +501,11 @@ int PageserverClient::delete_timeline(const TimelineId& timeline_id)
 
 int PageserverClient::check_availability()
 {
-    char* url = (char*)malloc(256);
-    snprintf(url, 256, "%s/health", base_url);
-    
-    HttpResponse response;
-    int result = make_http_request(url, &response);
+    char url[256];
+    snprintf(url, sizeof(url), "%s/health", base_url);
     
-    free(url);
-    return result;
+    control_response.clear();
+    return make_http_request(url, &control_response);
 }
 
 int PageserverClient::get_server_status()
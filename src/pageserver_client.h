@@ -19,19 +19,171 @@
 
 #include <curl/curl.h>
 #include <stdint.h>
+#include <cstdlib>
 
 // Common type definitions
 #include "serverless_types.h"
+#include "page_compression.h"
+
+class PageServiceClient;
+
+// Transport used for page reads (serverless_pageserver_protocol)
+enum PageserverProtocol {
+    PAGESERVER_PROTOCOL_HTTP = 0,     // One HTTP request per page or batch
+    PAGESERVER_PROTOCOL_BINARY = 1    // Pipelined binary page service over TCP
+};
 
 /**
- * HTTP response structure for libcurl
+ * Destination of an HTTP response body
+ *
+ * libcurl hands the body over in chunks; a sink stores each chunk
+ * where the caller wants the bytes to end up, so page data is never
+ * staged in an intermediate buffer. Returning false from append()
+ * aborts the transfer.
  */
-struct HttpResponse {
-    char* data;
-    size_t size;
-    
-    HttpResponse() : data(nullptr), size(0) {}
-    ~HttpResponse() { if (data) free(data); }
+class ResponseSink {
+public:
+    virtual ~ResponseSink() {}
+    virtual bool append(const char* data, size_t length) = 0;
+};
+
+// libcurl write callback; the write data must be a ResponseSink*
+size_t response_sink_callback(void* contents, size_t size, size_t nmemb, void* sink);
+
+/**
+ * Sink writing into one caller-provided buffer of fixed size
+ *
+ * A body longer than the buffer is detected, flagged and aborted
+ * instead of being truncated silently.
+ */
+class FrameSink : public ResponseSink {
+private:
+    char* frame;
+    size_t capacity;
+    size_t received;
+    bool overflow;
+
+public:
+    FrameSink() : frame(nullptr), capacity(0), received(0), overflow(false) {}
+    FrameSink(char* buffer, size_t buffer_size)
+        : frame(buffer), capacity(buffer_size), received(0), overflow(false) {}
+
+    void reset(char* buffer, size_t buffer_size) {
+        frame = buffer;
+        capacity = buffer_size;
+        received = 0;
+        overflow = false;
+    }
+
+    bool append(const char* data, size_t length) override;
+
+    size_t size() const { return received; }
+    bool overflowed() const { return overflow; }
+
+    // Zero the part of the buffer the body did not fill
+    void pad();
+};
+
+/**
+ * Sink for one page image that may arrive compressed
+ *
+ * The codec is taken from the Content-Encoding response header,
+ * which libcurl delivers before the body. A plain body goes straight
+ * into the frame; a compressed one is staged and decoded into the
+ * frame by finish(). Compressed bodies are never larger than a page:
+ * the pageserver sends pages that do not shrink uncompressed.
+ */
+class PageBodySink : public ResponseSink {
+private:
+    char* page_frame;
+    size_t page_size;
+    char* staging_area;
+    FrameSink plain;
+    FrameSink staged;
+    PageCompression encoding;
+    bool unknown_encoding;
+
+public:
+    PageBodySink()
+        : page_frame(nullptr), page_size(0), staging_area(nullptr),
+          encoding(PAGE_COMPRESSION_NONE), unknown_encoding(false) {}
+
+    void reset(char* frame, size_t frame_size, char* staging, size_t staging_size) {
+        page_frame = frame;
+        page_size = frame_size;
+        staging_area = staging;
+        plain.reset(frame, frame_size);
+        staged.reset(staging, staging_size);
+        encoding = PAGE_COMPRESSION_NONE;
+        unknown_encoding = false;
+    }
+
+    bool append(const char* data, size_t length) override;
+
+    // libcurl header callback; the header data is a PageBodySink* or
+    // null when the response is not a page
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, void* sink);
+
+    // Complete the frame (decode or zero-pad); -1 if the body is
+    // empty, too large or corrupt
+    int finish(PageDecompressor* decompressor);
+
+    PageCompression content_encoding() const { return encoding; }
+};
+
+/**
+ * Sink spreading consecutive page images over a list of frames
+ */
+class ScatterSink : public ResponseSink {
+private:
+    char* const* frames;
+    size_t count;
+    size_t received;
+
+public:
+    ScatterSink(char* const* page_frames, size_t page_count)
+        : frames(page_frames), count(page_count), received(0) {}
+
+    bool append(const char* data, size_t length) override;
+
+    // Every frame received in full
+    bool complete() const { return received == count * MARIADB_PAGE_SIZE; }
+};
+
+/**
+ * Growable NUL-terminated buffer for small control responses
+ *
+ * Owned by the client and reused across requests, so JSON and status
+ * replies allocate only when a reply is larger than any before it.
+ * Bodies beyond the limit are rejected.
+ */
+class ControlBuffer : public ResponseSink {
+private:
+    char* buffer;
+    size_t used;
+    size_t capacity;
+    size_t limit;
+
+public:
+    explicit ControlBuffer(size_t max_size = 1024 * 1024)
+        : buffer(nullptr), used(0), capacity(0), limit(max_size) {}
+    ~ControlBuffer() { free(buffer); }
+
+    // Delete copy constructor
+    ControlBuffer(const ControlBuffer&) = delete;
+    ControlBuffer& operator=(const ControlBuffer&) = delete;
+
+    void clear() {
+        used = 0;
+        if (buffer) {
+            buffer[0] = 0;
+        }
+    }
+
+    bool append(const char* data, size_t length) override;
+
+    const char* data() const { return buffer ? buffer : ""; }
+    size_t size() const { return used; }
 };
 
 /**
@@ -47,21 +199,44 @@ private:
     char* base_url;
     long timeout_seconds;
     
-    // HTTP response callback
-    static size_t write_callback(void* contents, size_t size, size_t nmemb, HttpResponse* response);
+    // Binary page protocol connection; page reads use HTTP when null
+    PageServiceClient* page_service;
+    
+    // Reused for timeline, health and other non-page responses
+    ControlBuffer control_response;
+    
+    // Codec requested for single page reads, with the request header
+    // announcing it and the staging area for compressed bodies
+    PageCompression compression;
+    struct curl_slist* page_headers;
+    char* staging_buffer;
+    PageDecompressor decompressor;
     
     // Helper methods
-    int make_http_request(const char* url, HttpResponse* response);
-    char* build_page_url(const PageId& page_id);
-    char* build_timeline_url(const TimelineId& timeline_id);
+    int make_http_request(const char* url, ResponseSink* sink);
+    int read_page_batch(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                        char* const* frames, size_t count, uint64_t lsn);
+    void build_page_url(const PageId& page_id, uint64_t lsn, char* url, size_t url_size);
+    void build_timeline_url(const TimelineId& timeline_id, char* url, size_t url_size);
     
 public:
     PageserverClient(const char* pageserver_url, long timeout = 30);
     ~PageserverClient();
     
-    // Core page operations
-    int read_page(const PageId& page_id, char* buffer, size_t buffer_size);
+    // Core page operations. A non-zero lsn asks for the page as of
+    // that LSN; the pageserver waits until it has applied the WAL up
+    // to it. Zero reads the latest version.
+    int read_page(const PageId& page_id, char* buffer, size_t buffer_size, uint64_t lsn = 0);
     int get_timeline_info(const TimelineId& timeline_id, uint64_t* latest_lsn);
+    // Fetch and parse the timeline's metadata; fails unless the reply
+    // carries at least an LSN
+    int get_timeline_info(const TimelineId& timeline_id, TimelineInfo* info);
+    
+    // Read many pages of one timeline with as few requests as possible.
+    // Page i is stored in frames[i], which must hold MARIADB_PAGE_SIZE
+    // bytes. Fails unless every page was received.
+    int read_pages(const TimelineId& timeline_id, const uint32_t* page_numbers,
+                   char* const* frames, size_t count, uint64_t lsn = 0);
     
     // Timeline management
     int create_timeline(const TimelineId& timeline_id);
@@ -74,6 +249,14 @@ public:
     // Configuration
     void set_timeout(long seconds) { timeout_seconds = seconds; }
     void set_base_url(const char* url);
+    
+    // Read pages over the binary page service at host:port instead of
+    // HTTP; timeline and health requests keep using HTTP
+    void set_page_service(const char* host, int port);
+    
+    // Ask for page images compressed with codec; the pageserver may
+    // still answer uncompressed. Batched HTTP reads are not compressed.
+    void set_compression(PageCompression codec);
 };
 
 #endif /* PAGESERVER_CLIENT_H */
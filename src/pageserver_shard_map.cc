@@ -0,0 +1,91 @@
+/*
+  Pageserver Shard Map Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Striped placement of timeline pages over several pageservers
+*/
+
+#include "pageserver_shard_map.h"
+#include <cstring>
+
+// Global shard map instance
+std::unique_ptr<PageserverShardMap> global_pageserver_shards;
+
+PageserverShardMap::PageserverShardMap(uint32_t stripe)
+    : stripe_pages(stripe ? stripe : 1)
+{
+}
+
+bool PageserverShardMap::initialize(const char* urls)
+{
+    shards.clear();
+
+    const char* entry = urls;
+    while (entry && *entry) {
+        const char* end = strchr(entry, ',');
+        size_t length = end ? (size_t)(end - entry) : strlen(entry);
+
+        // Trim blanks and trailing slashes
+        while (length > 0 && (*entry == ' ' || *entry == '\t')) {
+            entry++;
+            length--;
+        }
+        while (length > 0 && (entry[length - 1] == ' ' || entry[length - 1] == '\t' ||
+                              entry[length - 1] == '/')) {
+            length--;
+        }
+
+        if (length > 0) {
+            Shard shard;
+            shard.url.assign(entry, length);
+            shard.page_service_port = 0;
+
+            // Host is between the scheme and the port or path
+            size_t host_start = shard.url.find("://");
+            host_start = host_start == std::string::npos ? 0 : host_start + 3;
+            size_t host_end;
+            if (host_start < shard.url.size() && shard.url[host_start] == '[') {
+                // IPv6 literal: getaddrinfo() wants it without brackets
+                host_start++;
+                host_end = shard.url.find(']', host_start);
+            } else {
+                host_end = shard.url.find_first_of(":/", host_start);
+                host_end = host_end == std::string::npos ? shard.url.size() : host_end;
+            }
+            if (host_end == std::string::npos || host_end <= host_start) {
+                shards.clear();
+                return false;
+            }
+            shard.host = shard.url.substr(host_start, host_end - host_start);
+            shards.push_back(shard);
+        }
+
+        entry = end ? end + 1 : nullptr;
+    }
+
+    return !shards.empty();
+}
+
+void PageserverShardMap::set_page_service(int base_port)
+{
+    for (size_t i = 0; i < shards.size(); ++i) {
+        int port = base_port;
+        for (size_t j = 0; j < i; ++j) {
+            if (shards[j].host == shards[i].host) {
+                port++;
+            }
+        }
+        shards[i].page_service_port = port;
+    }
+}
+
+size_t PageserverShardMap::shard_for(const PageId& page_id) const
+{
+    if (shards.size() == 1) {
+        return 0;
+    }
+
+    // Fibonacci hashing spreads the timelines' first stripes
+    uint64_t first = (page_id.timeline_id * 0x9E3779B97F4A7C15ULL) >> 32;
+    return (first + page_id.page_number / stripe_pages) % shards.size();
+}
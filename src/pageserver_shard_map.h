@@ -0,0 +1,77 @@
+/*
+  Pageserver Shard Map for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Routes every page to one of several pageservers, so page read
+  bandwidth grows with the number of pageservers instead of being
+  bounded by a single one.
+*/
+
+#ifndef PAGESERVER_SHARD_MAP_H
+#define PAGESERVER_SHARD_MAP_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Common type definitions
+#include "serverless_types.h"
+
+/**
+ * Pageserver Shard Map
+ *
+ * A timeline is cut into stripes of stripe_pages consecutive pages,
+ * dealt round-robin over the shards. The timeline's first stripe
+ * goes to a shard chosen by hashing the timeline id, so the small
+ * tables do not all live on the first shard. A sequential scan moves
+ * to the next shard every stripe and keeps all of them busy once
+ * read-ahead spans several stripes.
+ *
+ * Timeline-wide requests (create, delete, metadata) go to every
+ * shard. The map is fixed after initialize() and is read without
+ * locking.
+ */
+class PageserverShardMap {
+public:
+    struct Shard {
+        std::string url;            // HTTP base URL, without trailing slash
+        std::string host;           // Host part of the URL, IPv6 without brackets
+        int page_service_port;      // Binary page service; 0 when reading over HTTP
+    };
+
+private:
+    std::vector<Shard> shards;
+    uint32_t stripe_pages;
+
+public:
+    explicit PageserverShardMap(uint32_t stripe_pages);
+
+    // Parse a comma separated list of pageserver base URLs
+    // ("http://ps1:9997,http://[fd00::2]:9997"). Fails on an empty
+    // list or an entry without a host.
+    bool initialize(const char* urls);
+
+    // Read pages over the binary page service at base_port on each
+    // shard's host. Shards sharing a host are told apart by port: the
+    // n-th of them listens on base_port + n.
+    void set_page_service(int base_port);
+
+    size_t shard_count() const { return shards.size(); }
+    const Shard& shard(size_t index) const { return shards[index]; }
+
+    // Shard holding the page
+    size_t shard_for(const PageId& page_id) const;
+};
+
+// Global shard map, set up before the connection pool and fetch engine
+extern std::unique_ptr<PageserverShardMap> global_pageserver_shards;
+
+#endif /* PAGESERVER_SHARD_MAP_H */
@@ -0,0 +1,166 @@
+/*
+  Sequential Read-Ahead Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  Stream detection and latency-driven window sizing
+*/
+
+#include "read_ahead.h"
+
+// Window of a newly detected stream
+static const uint32_t INITIAL_WINDOW = 4;
+
+ReadAhead::ReadAhead(uint32_t max_pages)
+    : current(nullptr), max_window(max_pages), page_limit(0), fetch_latency_us(0),
+      access_clock(0)
+{
+    reset();
+}
+
+void ReadAhead::reset()
+{
+    for (size_t i = 0; i < MAX_STREAMS; ++i) {
+        streams[i].active = false;
+    }
+    current = nullptr;
+}
+
+void ReadAhead::record_fetch_latency(uint64_t latency_us)
+{
+    // Exponential moving average, weight 1/8 for the new sample
+    if (fetch_latency_us == 0) {
+        fetch_latency_us = latency_us;
+    } else {
+        fetch_latency_us = (fetch_latency_us * 7 + latency_us) / 8;
+    }
+}
+
+ReadAhead::Stream* ReadAhead::find_stream(const PageId& page_id)
+{
+    for (size_t i = 0; i < MAX_STREAMS; ++i) {
+        Stream& stream = streams[i];
+        if (!stream.active || stream.timeline_id != page_id.timeline_id) {
+            continue;
+        }
+        // The page just read again, the next page, or one the stream
+        // already read ahead (the reader skipped a few pages)
+        if (page_id.page_number + 1 == stream.next_page ||
+            (page_id.page_number >= stream.next_page &&
+             page_id.page_number < (stream.ahead_until > stream.next_page ?
+                                    stream.ahead_until : stream.next_page + 1))) {
+            return &stream;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t ReadAhead::target_window(const Stream& stream) const
+{
+    uint32_t minimum = INITIAL_WINDOW < max_window ? INITIAL_WINDOW : max_window;
+
+    // Until both rates are known, only the ramp-up limits the window
+    if (fetch_latency_us == 0 || stream.interval_us == 0) {
+        return max_window;
+    }
+
+    // Pages consumed while one fetch is outstanding, twice over
+    uint64_t pages = 2 * (fetch_latency_us / stream.interval_us + 1);
+    if (pages < minimum) {
+        return minimum;
+    }
+    return pages > max_window ? max_window : (uint32_t)pages;
+}
+
+uint32_t ReadAhead::access(const PageId& page_id, uint64_t now_us, uint32_t* first_page)
+{
+    current = nullptr;
+    if (max_window == 0) {
+        return 0;
+    }
+
+    access_clock++;
+    Stream* stream = find_stream(page_id);
+
+    if (!stream) {
+        // Start a new stream in a free or the least recently used slot
+        stream = &streams[0];
+        for (size_t i = 0; i < MAX_STREAMS && stream->active; ++i) {
+            if (!streams[i].active || streams[i].last_used < stream->last_used) {
+                stream = &streams[i];
+            }
+        }
+
+        stream->timeline_id = page_id.timeline_id;
+        stream->next_page = page_id.page_number + 1;
+        stream->ahead_until = stream->next_page;
+        stream->window = INITIAL_WINDOW < max_window ? INITIAL_WINDOW : max_window;
+        stream->run = 1;
+        stream->last_done_us = 0;
+        stream->interval_us = 0;
+        stream->last_used = access_clock;
+        stream->active = true;
+        current = stream;
+        return 0;
+    }
+
+    // Another row of the page just read: the stream neither advances
+    // nor refills, and the reader's time keeps counting for the page
+    if (page_id.page_number + 1 == stream->next_page) {
+        stream->last_used = access_clock;
+        return 0;
+    }
+
+    // Time the reader spent between pages, excluding its own waits
+    if (stream->last_done_us && now_us > stream->last_done_us) {
+        uint64_t sample = now_us - stream->last_done_us;
+        stream->interval_us = stream->interval_us ? (stream->interval_us * 3 + sample) / 4 : sample;
+    }
+
+    stream->run++;
+    stream->next_page = page_id.page_number + 1;
+    stream->last_used = access_clock;
+    current = stream;
+
+    if (stream->ahead_until < stream->next_page) {
+        stream->ahead_until = stream->next_page;
+    }
+
+    // Refill once half of the window has been consumed
+    uint32_t lead = stream->ahead_until - stream->next_page;
+    if (lead > stream->window / 2) {
+        return 0;
+    }
+
+    // Ramp up towards the target while the stream keeps going; the
+    // first range of a stream uses the initial window
+    uint32_t target = target_window(*stream);
+    if (stream->run > 2 && stream->window * 2 < target) {
+        stream->window *= 2;
+    } else if (stream->run > 2 || stream->window > target) {
+        stream->window = target;
+    }
+
+    uint64_t end = (uint64_t)stream->next_page + stream->window;
+    if (end > UINT32_MAX) {
+        end = UINT32_MAX;
+    }
+    if (page_limit && end > page_limit) {
+        end = page_limit;
+    }
+    if (end <= stream->ahead_until) {
+        return 0;
+    }
+
+    *first_page = stream->ahead_until;
+    uint32_t count = (uint32_t)(end - stream->ahead_until);
+    stream->ahead_until = (uint32_t)end;
+    return count;
+}
+
+void ReadAhead::access_done(uint64_t now_us)
+{
+    if (current) {
+        current->last_done_us = now_us;
+        current = nullptr;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+  Sequential Read-Ahead for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Detects sequential page access by a handler and decides which pages
+  to request before they are needed, so a table scan waits for the
+  pageserver once per window instead of once per page.
+*/
+
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+
+// Common type definitions
+#include "serverless_types.h"
+
+/**
+ * Read-Ahead Detector
+ *
+ * Tracks a few independent sequential streams (one per timeline or
+ * per interleaved scan). Once a stream has read two consecutive
+ * pages, each access returns the range of following pages that
+ * should be requested now; the caller issues them and the detector
+ * remembers how far ahead of the reader it has already gone.
+ *
+ * The window starts small and doubles with every range issued, up to
+ * the number of pages the reader consumes during two page fetches:
+ * one window is read while the next is in flight. A stream that is
+ * broken by a non-sequential access starts over. Accessing the page
+ * just read again (the next row on the same page) leaves its stream
+ * as it is.
+ *
+ * Not thread safe; each handler owns one.
+ */
+class ReadAhead {
+private:
+    struct Stream {
+        uint64_t timeline_id;
+        uint32_t next_page;         // Page that continues the stream
+        uint32_t ahead_until;       // Pages below this were requested
+        uint32_t window;            // Current read-ahead window in pages
+        uint32_t run;               // Consecutive sequential accesses
+        uint64_t last_done_us;      // End of the previous access
+        uint64_t interval_us;       // Average reader time per page
+        uint64_t last_used;         // Replacement order
+        bool active;
+    };
+
+    static const size_t MAX_STREAMS = 4;
+
+    Stream streams[MAX_STREAMS];
+    Stream* current;                // Stream of the access in progress
+    uint32_t max_window;
+    uint32_t page_limit;            // Pages in the timeline; zero if unknown
+    uint64_t fetch_latency_us;      // Average latency of one page fetch
+    uint64_t access_clock;
+
+    Stream* find_stream(const PageId& page_id);
+    uint32_t target_window(const Stream& stream) const;
+
+public:
+    // Windows never grow beyond max_pages; zero disables read-ahead
+    explicit ReadAhead(uint32_t max_pages);
+
+    // Forget all streams (start of a new scan)
+    void reset();
+
+    // Never read ahead past the timeline's last page; zero when the
+    // size is unknown
+    void set_page_limit(uint32_t pages) { page_limit = pages; }
+
+    // Feed the observed duration of a page fetch
+    void record_fetch_latency(uint64_t latency_us);
+
+    // Note an access to page_id starting at now_us. Returns the number
+    // of pages to request now, starting at *first_page of the same
+    // timeline, or zero.
+    uint32_t access(const PageId& page_id, uint64_t now_us, uint32_t* first_page);
+
+    // The access started by access() is complete; the time until the
+    // next access is the reader's own processing time
+    void access_done(uint64_t now_us);
+
+    bool enabled() const { return max_window > 0; }
+};
+
+#endif /* READ_AHEAD_H */
@@ -7,24 +7,59 @@
 
 #include "safekeeper_client.h"
 #include "ha_serverless.h"
+#include <my_sys.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
 #include <unistd.h>
-#include <arpa/inet.h>
+#include <thread>
+
+// Requests in one batch; two iovecs each must stay below IOV_MAX
+static const size_t MAX_BATCH_REQUESTS = 256;
+
+// Submission ring slots: a slot stays taken until its record is
+// answered, so the ring holds at most this many full batches queued
+// and in flight together, which caps the window
+static const size_t WAL_QUEUE_SLOTS = 4096;
+static const size_t MAX_BATCHES_IN_FLIGHT = WAL_QUEUE_SLOTS / MAX_BATCH_REQUESTS;
+static_assert((WAL_QUEUE_SLOTS & (WAL_QUEUE_SLOTS - 1)) == 0,
+              "ring positions are masked");
+
+// Record copy a slot keeps allocated for its next record; larger ones
+// are freed once answered, so at most WAL_QUEUE_SLOTS times this
+// (128MB) stays allocated between bursts of large rows
+static const size_t MAX_KEPT_RECORD_COPY = 2 * MARIADB_PAGE_SIZE;
+
+// Seconds an acknowledgement may take before the stream is given up
+static const long ACK_TIMEOUT_SECONDS = 30;
 
 SafekeeperClient::SafekeeperClient(const char* host, int port)
     : server_host(nullptr), server_port(port), socket_fd(-1), 
-      connected(false), shutdown_requested(false)
+      connected(false), slots(new WalQueueSlot[WAL_QUEUE_SLOTS]), dequeue_position(0),
+      shutdown_requested(false), connection_request(CONNECTION_KEEP),
+      group_commit_delay_us(0), group_commit_max_bytes(1 << 20),
+      max_batches_in_flight(8), batch_sending(false), stream_broken(false),
+      stream_closing(false)
 {
     set_server_address(host, port);
     
+    for (size_t i = 0; i < WAL_QUEUE_SLOTS; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    
     // Start worker thread for async WAL append
     worker_thread = std::thread(&SafekeeperClient::worker_thread_main, this);
 }
 
 SafekeeperClient::~SafekeeperClient()
 {
-    // Shutdown worker thread
+    // Shutdown worker thread; it sends what is still queued first
     {
         std::lock_guard<std::mutex> lock(queue_mutex);
         shutdown_requested = true;
@@ -35,12 +70,6 @@ SafekeeperClient::~SafekeeperClient()
         worker_thread.join();
     }
     
-    // Clean up pending requests
-    while (!append_queue.empty()) {
-        delete append_queue.front();
-        append_queue.pop();
-    }
-    
     close_connection();
     
     if (server_host) {
@@ -63,27 +92,53 @@ int SafekeeperClient::establish_connection()
         return 0;
     }
     
-    socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd < 0) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", server_port);
+    
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    // Host names such as "localhost" as well as addresses
+    struct addrinfo* addresses;
+    if (getaddrinfo(server_host, port, &hints, &addresses) != 0) {
         return -1;
     }
     
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(server_port);
+    for (struct addrinfo* address = addresses; address; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            socket_fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
     
-    if (inet_pton(AF_INET, server_host, &server_addr.sin_addr) <= 0) {
-        close(socket_fd);
-        socket_fd = -1;
+    if (socket_fd < 0) {
         return -1;
     }
     
-    if (::connect(socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        close(socket_fd);
-        socket_fd = -1;
-        return -1;
+    // A record must not sit in the socket waiting for Nagle; a stalled
+    // safekeeper must not hold commits forever
+    int nodelay = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    struct timeval timeout;
+    timeout.tv_sec = ACK_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        stream_broken = false;
+        stream_closing = false;
     }
+    ack_thread = std::thread(&SafekeeperClient::ack_thread_main, this);
     
     connected = true;
     return 0;
@@ -91,6 +146,17 @@ int SafekeeperClient::establish_connection()
 
 void SafekeeperClient::close_connection()
 {
+    // Stop the reader first; it still uses the socket
+    if (ack_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            stream_closing = true;
+        }
+        stream_condition.notify_all();
+        shutdown(socket_fd, SHUT_RDWR);
+        ack_thread.join();
+    }
+    
     if (socket_fd >= 0) {
         close(socket_fd);
         socket_fd = -1;
@@ -100,6 +166,15 @@ void SafekeeperClient::close_connection()
 
 int SafekeeperClient::reconnect_if_needed()
 {
+    bool broken;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        broken = stream_broken;
+    }
+    if (broken) {
+        close_connection();
+    }
+    
     if (!connected) {
         return establish_connection();
     }
@@ -108,160 +183,532 @@ int SafekeeperClient::reconnect_if_needed()
 
 int SafekeeperClient::connect()
 {
-    return establish_connection();
+    request_connection(CONNECTION_OPEN);
+    return 0;
 }
 
 void SafekeeperClient::disconnect()
 {
-    close_connection();
+    request_connection(CONNECTION_CLOSE);
+}
+
+void SafekeeperClient::request_connection(ConnectionRequest request)
+{
+    // The worker owns the socket; the latest request wins
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        connection_request = request;
+    }
+    queue_condition.notify_one();
 }
 
-int SafekeeperClient::send_message(const char* data, size_t length)
+int SafekeeperClient::send_message(struct iovec* parts, int count)
 {
     if (!connected || socket_fd < 0) {
         return -1;
     }
     
-    ssize_t bytes_sent = send(socket_fd, data, length, 0);
-    return (bytes_sent == (ssize_t)length) ? 0 : -1;
+    // Header and payload leave in one call, without copying them
+    // together first
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = count;
+    
+    while (message.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(socket_fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        
+        // Skip what went out; a short write resumes mid-part
+        while (message.msg_iovlen > 0 && (size_t)sent >= message.msg_iov->iov_len) {
+            sent -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+    
+    return 0;
 }
 
-int SafekeeperClient::receive_message(char* buffer, size_t buffer_size)
+int SafekeeperClient::receive_message(char* buffer, size_t length)
 {
     if (!connected || socket_fd < 0) {
         return -1;
     }
     
-    ssize_t bytes_received = recv(socket_fd, buffer, buffer_size - 1, 0);
-    if (bytes_received > 0) {
-        buffer[bytes_received] = '\0';
-        return bytes_received;
+    while (length > 0) {
+        ssize_t received = recv(socket_fd, buffer, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return -1;
+        }
+        buffer += received;
+        length -= received;
     }
     
-    return -1;
+    return 0;
 }
 
-int SafekeeperClient::serialize_append_request(const TimelineId& timeline_id, 
-                                              const WalRecord& record, 
-                                              char* buffer, size_t buffer_size)
+void SafekeeperClient::serialize_request(const WalAppendRequest* request, uint16_t flags,
+                                         char* header)
 {
-    // Simple JSON serialization for now
-    int written = snprintf(buffer, buffer_size,
-        "{\"type\":\"append\",\"timeline_id\":%llu,\"lsn\":%llu,\"length\":%u,\"data\":\"%.*s\"}",
-        (unsigned long long)timeline_id.id, (unsigned long long)record.lsn, record.length, (int)record.length, record.data);
+    const WalRecord& record = request->record;
+    int4store(header, SAFEKEEPER_MAGIC);
+    int2store(header + 4, request->type);
+    int2store(header + 6, flags);
+    int8store(header + 8, request->timeline_id.id);
+    int8store(header + 16, record.lsn);
+    int4store(header + 24, record.length);
     
-    return (written < (int)buffer_size) ? written : -1;
+    uint32_t checksum = my_crc32c(0, header, 28);
+    checksum = my_crc32c(checksum, record.data, record.length);
+    int4store(header + 28, checksum);
 }
 
-int SafekeeperClient::deserialize_append_response(const char* buffer, size_t buffer_size,
-                                                 uint64_t* committed_lsn)
+bool SafekeeperClient::deserialize_response(const char* response, uint16_t type,
+                                            uint16_t* status, uint64_t* flush_lsn)
 {
-    // Simple parsing for now
-    *committed_lsn = 1;  // Placeholder
-    return 0;
+    // Anything unexpected means the stream is out of sync
+    if (uint4korr(response) != SAFEKEEPER_MAGIC || uint2korr(response + 6) != type) {
+        return false;
+    }
+    
+    *status = uint2korr(response + 4);
+    *flush_lsn = uint8korr(response + 16);
+    return true;
 }
 
-int SafekeeperClient::append_wal_record(const TimelineId& timeline_id, const WalRecord& record)
+WalAppendRequest* SafekeeperClient::claim_slot()
 {
-    if (reconnect_if_needed() != 0) {
-        return -1;
-    }
-    
-    char request_buffer[4096];
-    int request_length = serialize_append_request(timeline_id, record, 
-                                                 request_buffer, sizeof(request_buffer));
-    if (request_length < 0) {
-        return -1;
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+    for (unsigned attempt = 0; ; ++attempt) {
+        WalQueueSlot& slot = slots[position & (WAL_QUEUE_SLOTS - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        
+        if (difference == 0) {
+            // Free at our position: take it unless another writer did
+            if (enqueue_position.compare_exchange_weak(position, position + 1,
+                                                       std::memory_order_relaxed)) {
+                slot.request.position = position;
+                return &slot.request;
+            }
+        } else if (difference < 0) {
+            // Full: the slot still holds a record from the previous lap.
+            // Spin briefly, then sleep while the safekeeper catches up.
+            if (attempt < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            position = enqueue_position.load(std::memory_order_relaxed);
+        } else {
+            // Another writer claimed it first
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
     }
+}
+
+void SafekeeperClient::publish_slot(WalAppendRequest* request)
+{
+    WalQueueSlot& slot = slots[request->position & (WAL_QUEUE_SLOTS - 1)];
+    slot.sequence.store(request->position + 1, std::memory_order_release);
     
-    if (send_message(request_buffer, request_length) != 0) {
-        return -1;
-    }
+    int64_t length = request->record.length;
+    int64_t bytes = queued_bytes.fetch_add(length) + length;
+    queued_records++;
     
-    char response_buffer[1024];
-    if (receive_message(response_buffer, sizeof(response_buffer)) < 0) {
-        return -1;
+    // Wake a sleeping worker: worker_waiting pairs with the worker
+    // setting it before checking the counters, so one of the two sees
+    // the other, and only the first writer to clear it locks. A worker
+    // waiting out the group commit delay is woken by the record that
+    // fills a batch.
+    int64_t full = (int64_t)group_commit_max_bytes;
+    if ((worker_waiting.load() && worker_waiting.exchange(false)) ||
+        (bytes >= full && bytes - length < full)) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+        }
+        queue_condition.notify_one();
     }
-    
-    uint64_t committed_lsn;
-    return deserialize_append_response(response_buffer, strlen(response_buffer), &committed_lsn);
 }
 
-int SafekeeperClient::append_wal_record_async(const TimelineId& timeline_id, const WalRecord& record)
+void SafekeeperClient::release_slot(WalAppendRequest* request)
 {
-    WalAppendRequest* request = new WalAppendRequest(timeline_id, record);
+    WalQueueSlot& slot = slots[request->position & (WAL_QUEUE_SLOTS - 1)];
+    slot.sequence.store(request->position + WAL_QUEUE_SLOTS, std::memory_order_release);
+}
+
+int SafekeeperClient::submit_and_wait(const TimelineId& timeline_id, const WalRecord& record,
+                                      uint16_t type)
+{
+    // The caller's data stays valid until we return: no copy
+    WalAppendRequest* request = claim_slot();
+    request->timeline_id = timeline_id;
+    request->record = record;
+    request->type = type;
+    request->detached = false;
+    request->group = nullptr;
+    request->completed = false;
+    request->result = 0;
+    publish_slot(request);
     
+    int result;
     {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        append_queue.push(request);
+        std::unique_lock<std::mutex> lock(completion_mutex);
+        completion_condition.wait(lock, [request] { return request->completed; });
+        result = request->result;
+    }
+    release_slot(request);
+    return result;
+}
+
+int SafekeeperClient::append_wal_record(const TimelineId& timeline_id, const WalRecord& record)
+{
+    return submit_and_wait(timeline_id, record, SAFEKEEPER_APPEND);
+}
+
+int SafekeeperClient::append_wal_record_async(const TimelineId& timeline_id, const WalRecord& record,
+                                              WalAppendGroup* group)
+{
+    if (group) {
+        group->add();
     }
-    queue_condition.notify_one();
     
-    return 0;  // Async, so return success immediately
+    WalAppendRequest* request = claim_slot();
+    request->timeline_id = timeline_id;
+    request->record = record;
+    request->copy.assign(record.data, record.data + record.length);
+    request->record.data = request->copy.data();
+    request->type = SAFEKEEPER_APPEND;
+    request->detached = true;
+    request->group = group;
+    request->completed = false;
+    request->result = 0;
+    publish_slot(request);
+    
+    return 0;  // Queued; the group reports the outcome
 }
 
 void SafekeeperClient::worker_thread_main()
 {
     while (true) {
-        WalAppendRequest* request = nullptr;
-        
+        ConnectionRequest request;
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
-            queue_condition.wait(lock, [this] { 
-                return !append_queue.empty() || shutdown_requested; 
-            });
+            auto ready = [this] {
+                return batch_ready() || connection_request != CONNECTION_KEEP ||
+                    (shutdown_requested && queued_records <= 0);
+            };
+            while (!ready()) {
+                worker_waiting = true;
+                if (ready()) {
+                    break;
+                }
+                queue_condition.wait(lock);
+            }
+            worker_waiting = false;
+            request = connection_request;
+            connection_request = CONNECTION_KEEP;
             
-            if (shutdown_requested) {
-                break;
+            if (request == CONNECTION_KEEP && queued_records <= 0) {
+                break;      // Shutdown with nothing left to send
             }
             
-            if (!append_queue.empty()) {
-                request = append_queue.front();
-                append_queue.pop();
+            // Let concurrent writers join the batch
+            uint32_t delay_us = group_commit_delay_us;
+            if (request == CONNECTION_KEEP && delay_us > 0 && !shutdown_requested &&
+                queued_bytes < (int64_t)group_commit_max_bytes) {
+                queue_condition.wait_for(lock, std::chrono::microseconds(delay_us),
+                                         [this] {
+                    return queued_bytes >= (int64_t)group_commit_max_bytes || shutdown_requested;
+                });
             }
         }
         
-        if (request) {
-            request->result = process_append_request(request);
-            request->completed = true;
-            // In a full implementation, we'd notify waiters here
-            delete request;
+        // connect() or disconnect()
+        if (request == CONNECTION_CLOSE) {
+            hang_up();
+            continue;
+        }
+        if (request == CONNECTION_OPEN) {
+            reconnect_if_needed();
+            continue;
+        }
+        
+        // Writers may publish out of ring order: with a later record
+        // published and counted while an earlier claimed slot is not yet
+        // published, nothing can be taken. Let that writer finish.
+        take_batch();
+        if (batch.empty()) {
+            std::this_thread::yield();
+            continue;
         }
+        
+        send_batch();
     }
+    
+    hang_up();
 }
 
-int SafekeeperClient::process_append_request(WalAppendRequest* request)
+void SafekeeperClient::hang_up()
 {
-    return append_wal_record(request->timeline_id, request->record);
+    // Collect the answers to the batches in flight first
+    {
+        std::unique_lock<std::mutex> lock(stream_mutex);
+        stream_condition.wait(lock, [this] { return in_flight.empty() || stream_broken; });
+    }
+    close_connection();
 }
 
-int SafekeeperClient::read_wal_record(const TimelineId& timeline_id, uint64_t lsn, 
-                                     char* buffer, size_t buffer_size)
+bool SafekeeperClient::batch_ready() const
 {
-    // Placeholder implementation
-    return -1;  // Not implemented yet
+    if (queued_records <= 0) {
+        return false;
+    }
+    
+    // Nothing in flight: send whatever is queued
+    size_t busy = batches_in_flight.load();
+    if (busy == 0) {
+        return true;
+    }
+    
+    // Behind unacknowledged batches, stream only full ones; smaller
+    // ones wait for an answer and grow meanwhile
+    return busy < max_batches_in_flight &&
+        (queued_bytes >= (int64_t)group_commit_max_bytes ||
+         queued_records >= (int64_t)MAX_BATCH_REQUESTS ||
+         shutdown_requested);
 }
 
-int SafekeeperClient::create_timeline(const TimelineId& timeline_id)
+void SafekeeperClient::wake_worker()
+{
+    // Taking the lock orders this with the worker's predicate check
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+    }
+    queue_condition.notify_one();
+}
+
+void SafekeeperClient::take_batch()
+{
+    // At least one request, however large
+    size_t bytes = 0;
+    size_t max_bytes = group_commit_max_bytes;
+    batch.clear();
+    while (batch.size() < MAX_BATCH_REQUESTS) {
+        WalQueueSlot& slot = slots[dequeue_position & (WAL_QUEUE_SLOTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+            break;      // Not published yet
+        }
+        WalAppendRequest* request = &slot.request;
+        if (!batch.empty() && bytes + request->record.length > max_bytes) {
+            break;
+        }
+        
+        // The slot stays taken until the record is answered
+        dequeue_position++;
+        bytes += request->record.length;
+        batch.push_back(request);
+    }
+    queued_records -= batch.size();
+    queued_bytes -= bytes;
+}
+
+void SafekeeperClient::send_batch()
 {
     if (reconnect_if_needed() != 0) {
-        return -1;
+        batches_failed++;
+        complete_batch(&batch, -1);
+        return;
     }
     
-    char request_buffer[256];
-    snprintf(request_buffer, sizeof(request_buffer),
-             "{\"type\":\"create_timeline\",\"timeline_id\":%llu}", (unsigned long long)timeline_id.id);
+    // Headers and payloads of the whole batch leave in one call
+    batch_headers.resize(batch.size() * SAFEKEEPER_REQUEST_SIZE);
+    batch_parts.clear();
+    size_t bytes = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        char* header = &batch_headers[i * SAFEKEEPER_REQUEST_SIZE];
+        serialize_request(batch[i], i + 1 < batch.size() ? SAFEKEEPER_FLAG_MORE : 0, header);
+        
+        struct iovec part;
+        part.iov_base = header;
+        part.iov_len = SAFEKEEPER_REQUEST_SIZE;
+        batch_parts.push_back(part);
+        if (batch[i]->record.length > 0) {
+            part.iov_base = const_cast<char*>(batch[i]->record.data);
+            part.iov_len = batch[i]->record.length;
+            batch_parts.push_back(part);
+        }
+        bytes += SAFEKEEPER_REQUEST_SIZE + batch[i]->record.length;
+    }
     
-    if (send_message(request_buffer, strlen(request_buffer)) != 0) {
-        return -1;
+    // In flight before the first byte leaves: the answer may arrive
+    // before sendmsg() returns
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        InFlightBatch sent;
+        sent.last_type = batch.back()->type;
+        sent.bytes = bytes;
+        sent.requests.swap(batch);
+        in_flight.push_back(std::move(sent));
+        batches_in_flight = in_flight.size();
+        batch_sending = true;
     }
+    stream_condition.notify_all();
     
-    char response_buffer[1024];
-    if (receive_message(response_buffer, sizeof(response_buffer)) < 0) {
-        return -1;
+    int result = send_message(batch_parts.data(), batch_parts.size());
+    
+    // A batch being written is left to us when the stream breaks, as
+    // its records may still be read by sendmsg()
+    std::vector<InFlightBatch> failed;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        batch_sending = false;
+        if (result != 0 && !stream_broken) {
+            stream_broken = true;
+            shutdown(socket_fd, SHUT_RDWR);
+        }
+        if (stream_broken) {
+            while (!in_flight.empty()) {
+                failed.push_back(std::move(in_flight.front()));
+                in_flight.pop_front();
+            }
+            batches_in_flight = 0;
+        }
     }
+    stream_condition.notify_all();
     
-    return 0;  // Success for now
+    for (InFlightBatch& sent : failed) {
+        batches_failed++;
+        complete_batch(&sent.requests, -1);
+    }
+}
+
+void SafekeeperClient::complete_batch(std::vector<WalAppendRequest*>* requests, int result)
+{
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        for (WalAppendRequest* request : *requests) {
+            if (request->detached) {
+                if (request->group) {
+                    request->group->complete(result == 0, request->record.lsn);
+                }
+                if (request->copy.capacity() > MAX_KEPT_RECORD_COPY) {
+                    std::vector<char>().swap(request->copy);
+                }
+                release_slot(request);
+                continue;
+            }
+            request->result = result;
+            request->completed = true;
+        }
+    }
+    completion_condition.notify_all();
+    requests->clear();
+}
+
+void SafekeeperClient::ack_thread_main()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stream_mutex);
+            stream_condition.wait(lock, [this] { return !in_flight.empty() || stream_closing; });
+            if (in_flight.empty()) {
+                return;
+            }
+        }
+        
+        // Only the reader removes batches, so the oldest one stays put
+        // while its answer is read
+        char response[SAFEKEEPER_RESPONSE_SIZE];
+        uint16_t status;
+        uint64_t acked_lsn;
+        InFlightBatch acknowledged;
+        {
+            bool in_sync = receive_message(response, sizeof(response)) == 0;
+            
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            in_sync = in_sync && !in_flight.empty() &&
+                deserialize_response(response, in_flight.front().last_type, &status, &acked_lsn);
+            if (in_sync) {
+                acknowledged = std::move(in_flight.front());
+                in_flight.pop_front();
+                batches_in_flight = in_flight.size();
+            }
+        }
+        
+        if (acknowledged.requests.empty()) {
+            fail_stream();
+            return;
+        }
+        stream_condition.notify_all();
+        wake_worker();
+        
+        if (status == SAFEKEEPER_OK) {
+            records_sent += acknowledged.requests.size();
+            batches_sent++;
+            bytes_sent += acknowledged.bytes;
+            
+            // Acknowledgements arrive in order, so flushed LSNs only grow
+            if (acked_lsn > flush_lsn.load()) {
+                flush_lsn = acked_lsn;
+            }
+        } else {
+            batches_failed++;
+        }
+        complete_batch(&acknowledged.requests, status == SAFEKEEPER_OK ? 0 : -1);
+    }
+}
+
+void SafekeeperClient::fail_stream()
+{
+    std::vector<InFlightBatch> failed;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        if (!stream_broken) {
+            stream_broken = true;
+            shutdown(socket_fd, SHUT_RDWR);
+        }
+        
+        // The worker fails the batch it is still writing itself
+        size_t keep = batch_sending ? 1 : 0;
+        while (in_flight.size() > keep) {
+            failed.push_back(std::move(in_flight.front()));
+            in_flight.pop_front();
+        }
+        batches_in_flight = in_flight.size();
+    }
+    stream_condition.notify_all();
+    wake_worker();
+    
+    for (InFlightBatch& sent : failed) {
+        batches_failed++;
+        complete_batch(&sent.requests, -1);
+    }
+}
+
+int SafekeeperClient::read_wal_record(const TimelineId& timeline_id, uint64_t lsn, 
+                                     char* buffer, size_t buffer_size)
+{
+    // Placeholder implementation
+    return -1;  // Not implemented yet
+}
+
+int SafekeeperClient::create_timeline(const TimelineId& timeline_id)
+{
+    return submit_and_wait(timeline_id, WalRecord(0, 0, nullptr), SAFEKEEPER_CREATE_TIMELINE);
 }
 
 int SafekeeperClient::get_timeline_status(const TimelineId& timeline_id, uint64_t* latest_lsn)
@@ -277,5 +724,34 @@ int SafekeeperClient::get_server_status()
 
 int SafekeeperClient::check_availability()
 {
-    return reconnect_if_needed();
+    // Only the worker reconnects, before its next batch
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    return connected && !stream_broken ? 0 : -1;
+}
+
+void SafekeeperClient::set_group_commit(uint32_t delay_us, size_t max_bytes)
+{
+    {
+        // Under the lock, so a waiting worker sees both before it wakes
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        group_commit_delay_us = delay_us;
+        group_commit_max_bytes = max_bytes;
+    }
+    queue_condition.notify_one();
+}
+
+void SafekeeperClient::set_max_batches_in_flight(size_t max_batches)
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    max_batches_in_flight = std::min(std::max(max_batches, (size_t)1), MAX_BATCHES_IN_FLIGHT);
+}
+
+SafekeeperClient::WalStats SafekeeperClient::get_stats() const
+{
+    WalStats stats;
+    stats.records = records_sent.load();
+    stats.batches = batches_sent.load();
+    stats.bytes = bytes_sent.load();
+    stats.failed_batches = batches_failed.load();
+    return stats;
 }
@@ -19,26 +19,137 @@
 
 #include <stdint.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
-#include <queue>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
 
 // Common type definitions
 #include "serverless_types.h"
 
+/*
+  Wire format. All integers are little-endian.
+
+  Request header (SAFEKEEPER_REQUEST_SIZE bytes), followed by
+  payload_length bytes of WAL record data:
+    0   uint32  magic           SAFEKEEPER_MAGIC
+    4   uint16  type            SAFEKEEPER_APPEND or SAFEKEEPER_CREATE_TIMELINE
+    6   uint16  flags           SAFEKEEPER_FLAG_MORE: not the last
+                                message of its batch
+    8   uint64  timeline_id
+    16  uint64  lsn             LSN of the record; 0 for CREATE_TIMELINE
+    24  uint32  payload_length
+    28  uint32  checksum        CRC-32C of bytes 0-27 and the payload
+
+  Response (SAFEKEEPER_RESPONSE_SIZE bytes):
+    0   uint32  magic
+    4   uint16  status          SAFEKEEPER_OK or an error code
+    6   uint16  type            type of the request answered
+    8   uint64  timeline_id
+    16  uint64  flush_lsn       WAL of the timeline is durable up to here
+
+  The payload is sent as is, so records may hold any bytes and are
+  only limited in size by the 32-bit length.
+
+  Messages are sent in batches (group commit). The safekeeper answers
+  only the last message of a batch, once the whole batch is durable;
+  a non-OK status fails every message of the batch.
+
+  The client streams: it sends further batches without waiting for
+  the answers to earlier ones. The safekeeper answers batches in the
+  order they were sent, so each answer acknowledges the oldest batch
+  not yet acknowledged.
+*/
+static const uint32_t SAFEKEEPER_MAGIC = 0x31574B53;       // "SKW1"
+static const uint16_t SAFEKEEPER_APPEND = 1;
+static const uint16_t SAFEKEEPER_CREATE_TIMELINE = 2;
+static const uint16_t SAFEKEEPER_FLAG_MORE = 1;
+static const uint16_t SAFEKEEPER_OK = 0;
+static const size_t SAFEKEEPER_REQUEST_SIZE = 32;
+static const size_t SAFEKEEPER_RESPONSE_SIZE = 24;
+
 /**
- * WAL append request for async processing
+ * Completion tracker for asynchronous WAL appends
+ *
+ * A writer passes the group to each append_wal_record_async() and
+ * waits on it where its records must be durable, typically at
+ * commit. The safekeeper acknowledges records in the order they were
+ * appended, so once wait() returns every record added so far is
+ * durable up to durable_lsn(), unless some of them failed.
+ */
+class WalAppendGroup {
+private:
+    std::mutex mutex;
+    std::condition_variable all_done;
+    size_t outstanding;
+    size_t failures;
+    uint64_t durable;
+
+public:
+    WalAppendGroup() : outstanding(0), failures(0), durable(0) {}
+    
+    // Records still queued hold a pointer to the group
+    ~WalAppendGroup() { wait(); }
+    
+    void add() {
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding++;
+    }
+    
+    void complete(bool ok, uint64_t lsn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) {
+            failures++;
+        } else if (lsn > durable) {
+            durable = lsn;
+        }
+        if (--outstanding == 0) {
+            all_done.notify_all();
+        }
+    }
+    
+    // Wait for every added record; returns the number that failed
+    // since the previous wait()
+    size_t wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [this] { return outstanding == 0; });
+        size_t failed = failures;
+        failures = 0;
+        return failed;
+    }
+    
+    // Highest LSN of the group's records acknowledged as durable
+    uint64_t durable_lsn() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return durable;
+    }
+};
+
+/**
+ * WAL append request, held in a slot of the client's submission ring
  */
 struct WalAppendRequest {
     TimelineId timeline_id;
     WalRecord record;
+    uint16_t type;
+    bool detached;          // Nobody waits; the worker frees the slot
+    WalAppendGroup* group;  // Detached requests: completed with the result
+    std::vector<char> copy; // Detached requests: record data, which the
+                            // caller may reuse as soon as it is queued.
+                            // Kept with the slot up to a bound, so
+                            // small records stop allocating.
     bool completed;
     int result;
+    size_t position;        // Ring position the slot was claimed at
     
-    WalAppendRequest(const TimelineId& tl_id, const WalRecord& wal_record)
-        : timeline_id(tl_id), record(wal_record), completed(false), result(0) {}
+    WalAppendRequest()
+        : timeline_id(0), record(0, 0, nullptr), type(SAFEKEEPER_APPEND), detached(false),
+          group(nullptr), completed(false), result(0), position(0) {}
 };
 
 /**
@@ -47,41 +158,147 @@ struct WalAppendRequest {
  * Handles TCP communication with the Rust safekeeper service
  * to stream WAL records for durability. Implements async
  * WAL append queue and connection management for high performance.
+ *
+ * Every request goes through the submission ring to the worker
+ * thread, which does all socket I/O. The worker commits in groups: it
+ * takes all requests queued while the previous batch was in flight
+ * (optionally waiting a short delay for more), sends them with one
+ * system call and completes all of them on the single
+ * acknowledgement. Threads sharing a client therefore share safekeeper
+ * round trips and fsyncs.
+ *
+ * Batches are streamed: an acknowledgement reader thread completes
+ * them as the answers arrive, while the worker goes on sending. With
+ * nothing in flight the worker sends whatever is queued; behind
+ * unacknowledged batches it only sends full ones (up to
+ * max_batches_in_flight), so small commits keep being grouped while
+ * bulk writes use the whole bandwidth. An I/O error fails every batch
+ * in flight; the worker reconnects for the next one.
+ *
+ * The submission ring is a bounded multi-producer, single-consumer
+ * queue of preallocated request slots: writers claim a slot with a
+ * compare-and-swap, fill it and publish it through the slot's
+ * sequence number, without locking or allocating. The worker takes
+ * published slots in ring order and a slot is freed once its record
+ * is answered, so the ring also bounds the records queued and in
+ * flight. Writers finding it full back off until slots are freed.
  */
 class SafekeeperClient {
 private:
+    // Batch sent and not yet acknowledged
+    struct InFlightBatch {
+        std::vector<WalAppendRequest*> requests;
+        uint16_t last_type;     // Type the answer carries
+        size_t bytes;
+    };
+    
     // Connection details
     char* server_host;
     int server_port;
     int socket_fd;
-    bool connected;
+    std::atomic<bool> connected;
+    
+    // Submission ring. A slot's sequence equals the position it can
+    // be claimed at when free, that position + 1 once published, and
+    // becomes position + WAL_QUEUE_SLOTS when the slot is freed.
+    struct WalQueueSlot {
+        std::atomic<size_t> sequence;
+        WalAppendRequest request;
+    };
+    std::unique_ptr<WalQueueSlot[]> slots;
+    std::atomic<size_t> enqueue_position{0};
+    size_t dequeue_position;                    // Worker thread only
     
-    // Async WAL append queue
-    std::queue<WalAppendRequest*> append_queue;
+    // Published and not yet taken by the worker. Writers count after
+    // publishing, so the worker may briefly see them negative.
+    std::atomic<int64_t> queued_records{0};
+    std::atomic<int64_t> queued_bytes{0};
+    
+    // The worker sleeps on queue_condition; writers only lock
+    // queue_mutex to wake it, when worker_waiting is set or their
+    // record fills a batch
     std::thread worker_thread;
     std::mutex queue_mutex;
     std::condition_variable queue_condition;
+    std::atomic<bool> worker_waiting{false};
     bool shutdown_requested;
     
-    // Connection management
+    // Connection change asked for by connect() or disconnect(), for
+    // the worker to make (under queue_mutex)
+    enum ConnectionRequest { CONNECTION_KEEP, CONNECTION_OPEN, CONNECTION_CLOSE };
+    ConnectionRequest connection_request;
+    
+    // Waiters of synchronous requests
+    std::mutex completion_mutex;
+    std::condition_variable completion_condition;
+    
+    // Group commit: wait up to group_commit_delay_us after the first
+    // queued request unless group_commit_max_bytes are queued. Writers
+    // read them without locking and they may change at any time.
+    std::atomic<uint32_t> group_commit_delay_us;
+    std::atomic<size_t> group_commit_max_bytes;
+    size_t max_batches_in_flight;
+    
+    // Batch being sent (worker thread only)
+    std::vector<WalAppendRequest*> batch;
+    std::vector<char> batch_headers;
+    std::vector<struct iovec> batch_parts;
+    
+    // Streaming: batches on the wire, oldest first. The worker appends
+    // and the acknowledgement reader removes them.
+    std::deque<InFlightBatch> in_flight;
+    std::atomic<size_t> batches_in_flight{0};   // in_flight.size(), for the worker
+    bool batch_sending;             // Newest batch is still being written
+    bool stream_broken;             // I/O error; reconnect before sending
+    bool stream_closing;            // Reader exits once nothing is in flight
+    std::thread ack_thread;
+    std::mutex stream_mutex;
+    std::condition_variable stream_condition;
+    std::atomic<uint64_t> flush_lsn{0};         // Highest LSN acknowledged durable
+    
+    // Statistics
+    std::atomic<uint64_t> records_sent{0};
+    std::atomic<uint64_t> batches_sent{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> batches_failed{0};
+    
+    // Connection management (worker thread only)
     int establish_connection();
     void close_connection();
     int reconnect_if_needed();
+    void hang_up();
+    
+    // Ask the worker to connect or hang up
+    void request_connection(ConnectionRequest request);
     
     // Message serialization
-    int serialize_append_request(const TimelineId& timeline_id, 
-                                 const WalRecord& record, 
-                                 char* buffer, size_t buffer_size);
-    int deserialize_append_response(const char* buffer, size_t buffer_size,
-                                    uint64_t* committed_lsn);
+    void serialize_request(const WalAppendRequest* request, uint16_t flags, char* header);
+    bool deserialize_response(const char* response, uint16_t type,
+                              uint16_t* status, uint64_t* flush_lsn);
+    
+    // Submission ring
+    WalAppendRequest* claim_slot();
+    void publish_slot(WalAppendRequest* request);
+    void release_slot(WalAppendRequest* request);
+    
+    // Queue a request and wait until the worker has completed it
+    int submit_and_wait(const TimelineId& timeline_id, const WalRecord& record, uint16_t type);
     
     // Async worker thread
     void worker_thread_main();
-    int process_append_request(WalAppendRequest* request);
+    bool batch_ready() const;
+    void wake_worker();
+    void take_batch();
+    void send_batch();
+    void complete_batch(std::vector<WalAppendRequest*>* requests, int result);
+    
+    // Acknowledgement reader thread
+    void ack_thread_main();
+    void fail_stream();
     
     // Low-level TCP operations
-    int send_message(const char* data, size_t length);
-    int receive_message(char* buffer, size_t buffer_size);
+    int send_message(struct iovec* parts, int count);
+    int receive_message(char* buffer, size_t length);
     
 public:
     SafekeeperClient(const char* host, int port);
@@ -89,7 +306,12 @@ public:
     
     // Core WAL operations
     int append_wal_record(const TimelineId& timeline_id, const WalRecord& record);
-    int append_wal_record_async(const TimelineId& timeline_id, const WalRecord& record);
+    // Queue a record without waiting for it. The record data is
+    // copied. With a group, the record is added to it and completed
+    // once the safekeeper has answered; without one, failures are
+    // only counted.
+    int append_wal_record_async(const TimelineId& timeline_id, const WalRecord& record,
+                                WalAppendGroup* group = nullptr);
     int read_wal_record(const TimelineId& timeline_id, uint64_t lsn, 
                         char* buffer, size_t buffer_size);
     
@@ -97,17 +319,38 @@ public:
     int create_timeline(const TimelineId& timeline_id);
     int get_timeline_status(const TimelineId& timeline_id, uint64_t* latest_lsn);
     
-    // Connection management
+    // Connection management. The worker thread connects or hangs up
+    // for these; is_connected() reports the outcome.
     int connect();
     void disconnect();
     bool is_connected() const { return connected; }
     
-    // Status and health
+    // Status and health. check_availability() reports whether the
+    // connection is up and unbroken; it does not reconnect.
     int get_server_status();
     int check_availability();
     
     // Configuration
     void set_server_address(const char* host, int port);
+    void set_group_commit(uint32_t delay_us, size_t max_bytes);
+    
+    // Unacknowledged batches kept on the wire; 1 waits for every
+    // answer before sending the next batch. At most 16: the
+    // submission ring holds no more full batches.
+    void set_max_batches_in_flight(size_t max_batches);
+    
+    // Highest LSN the safekeeper has acknowledged as durable
+    uint64_t flushed_lsn() const { return flush_lsn.load(); }
+    
+    // Statistics and monitoring
+    struct WalStats {
+        uint64_t records;
+        uint64_t batches;
+        uint64_t bytes;
+        uint64_t failed_batches;
+    };
+    
+    WalStats get_stats() const;
 };
 
 #endif /* SAFEKEEPER_CLIENT_H */
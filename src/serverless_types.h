@@ -8,6 +8,9 @@
 
 #include <stdint.h>
 
+// MariaDB page size (16KB)
+static const uint32_t MARIADB_PAGE_SIZE = 16384;
+
 // Page and timeline identifiers
 struct PageId {
     uint64_t timeline_id;
@@ -23,6 +26,16 @@ struct TimelineId {
     TimelineId(uint64_t timeline_id) : id(timeline_id) {}
 };
 
+// Timeline metadata reported by the pageserver
+struct TimelineInfo {
+    uint64_t latest_lsn;        // Newest LSN pages can be read at
+    uint64_t last_record_lsn;   // End of the last WAL record received
+    uint64_t page_count;        // Pages in the timeline
+    uint64_t logical_size;      // Bytes of table data
+
+    TimelineInfo() : latest_lsn(0), last_record_lsn(0), page_count(0), logical_size(0) {}
+};
+
 // WAL record for safekeeper
 struct WalRecord {
     uint64_t lsn;           // Log Sequence Number
@@ -0,0 +1,71 @@
+/*
+  Timeline Metadata Cache Implementation
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  TTL cache of pageserver timeline metadata
+*/
+
+#include "timeline_info_cache.h"
+
+// Global timeline info cache instance
+std::unique_ptr<TimelineInfoCache> global_timeline_info_cache;
+
+TimelineInfoCache::TimelineInfoCache(std::chrono::milliseconds ttl)
+    : time_to_live(ttl), generation(0)
+{
+}
+
+bool TimelineInfoCache::lookup(const TimelineId& timeline_id, TimelineInfo* info,
+                               uint64_t* fetch_generation)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    auto it = entries.find(timeline_id.id);
+    if (it != entries.end()) {
+        if (std::chrono::steady_clock::now() < it->second.expires) {
+            *info = it->second.info;
+            hits++;
+            return true;
+        }
+        entries.erase(it);
+    }
+
+    *fetch_generation = generation;
+    misses++;
+    return false;
+}
+
+void TimelineInfoCache::store(const TimelineId& timeline_id, const TimelineInfo& info,
+                              uint64_t fetch_generation)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // Invalidated while the caller was fetching: the data may predate it
+    if (fetch_generation != generation) {
+        return;
+    }
+
+    Entry& entry = entries[timeline_id.id];
+    entry.info = info;
+    entry.expires = std::chrono::steady_clock::now() + time_to_live;
+}
+
+void TimelineInfoCache::invalidate(const TimelineId& timeline_id)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    generation++;
+    entries.erase(timeline_id.id);
+    invalidations++;
+}
+
+TimelineInfoCache::CacheStats TimelineInfoCache::get_stats() const
+{
+    CacheStats stats;
+    stats.hits = hits.load();
+    stats.misses = misses.load();
+    stats.invalidations = invalidations.load();
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    stats.timelines = entries.size();
+    return stats;
+}
@@ -0,0 +1,82 @@
+/*
+  Timeline Metadata Cache for Serverless MariaDB Storage Engine
+  Copyright (c) 2024 Serverless MariaDB Project
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  Keeps recently fetched timeline metadata so table statistics and
+  LSN lookups do not cost a pageserver round trip every time.
+*/
+
+#ifndef TIMELINE_INFO_CACHE_H
+#define TIMELINE_INFO_CACHE_H
+
+// MariaDB types first
+#include "my_global.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Common type definitions
+#include "serverless_types.h"
+
+/**
+ * Timeline Info Cache
+ *
+ * Entries expire after a fixed time to live and are dropped early
+ * when the timeline is written, created or deleted. A lookup miss
+ * hands out a generation; storing the fetched metadata with it is a
+ * no-op if an invalidation happened in between, so a slow fetch can
+ * never reinstate data older than the invalidation.
+ */
+class TimelineInfoCache {
+private:
+    struct Entry {
+        TimelineInfo info;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    std::chrono::milliseconds time_to_live;
+
+    mutable std::mutex cache_mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    uint64_t generation;            // Bumped by every invalidation
+
+    // Statistics
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> invalidations{0};
+
+public:
+    explicit TimelineInfoCache(std::chrono::milliseconds ttl);
+
+    // True with *info filled when a fresh entry exists; otherwise
+    // *fetch_generation is set for the following store()
+    bool lookup(const TimelineId& timeline_id, TimelineInfo* info, uint64_t* fetch_generation);
+
+    void store(const TimelineId& timeline_id, const TimelineInfo& info, uint64_t fetch_generation);
+
+    // Drop the timeline's entry
+    void invalidate(const TimelineId& timeline_id);
+
+    // Statistics and monitoring
+    struct CacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;
+        size_t timelines;
+    };
+
+    CacheStats get_stats() const;
+};
+
+// Global timeline info cache (null when caching is disabled)
+extern std::unique_ptr<TimelineInfoCache> global_timeline_info_cache;
+
+#endif /* TIMELINE_INFO_CACHE_H */